@@ -1,422 +1,1154 @@
 /*
  * Buddy Page Allocation Algorithm
- * SKELETON IMPLEMENTATION -- TO BE FILLED IN FOR TASK (2)
  */
 
 /*
- * STUDENT NUMBER: s
+ * STUDENT NUMBER: s1346249
  */
+#include "buddy.h"
+#include "cycle-counter.h"
 #include <infos/mm/page-allocator.h>
 #include <infos/mm/mm.h>
 #include <infos/kernel/kernel.h>
 #include <infos/kernel/log.h>
 #include <infos/util/math.h>
 #include <infos/util/printf.h>
+#include <infos/util/string.h>
+#include <infos/util/cmdline.h>
+#include <infos/util/lock.h>
 
 using namespace infos::kernel;
 using namespace infos::mm;
 using namespace infos::util;
 
-#define MAX_ORDER    17
+#define MAX_ORDER	17
+
+/*
+ * Marks the end of a free list in the back-link table.
+ */
+#define NO_PFN		((uint32_t)~0u)
+
+/*
+ * The number of slots used by the stress benchmark, and the largest order it allocates.
+ */
+#define BENCH_SLOTS		256
+#define BENCH_MAX_ORDER	3
+
+/*
+ * The batch size used to compare bulk allocation with page-at-a-time allocation, and
+ * the largest exact allocation the benchmark makes.
+ */
+#define BENCH_BULK_PAGES	64
+#define BENCH_EXACT_PAGES	64
+
+/*
+ * Small-order blocks are cached in front of the buddy lists for orders below PCP_ORDERS.
+ * The watermarks and batch size are in pages, and are scaled down by the block size for
+ * each order.
+ */
+#define PCP_ORDERS				4
+#define PCP_BATCH				16
+#define PCP_LOW_WATERMARK		32
+#define PCP_HIGH_WATERMARK		64
+
+static uint64_t bench_iterations;
+static bool pcp_enabled = true;
+
+RegisterCmdLineArgument(BuddyPageCache, "pgalloc.pcp") {
+	pcp_enabled = strncmp(value, "0", 2) != 0;
+}
+
+RegisterCmdLineArgument(BuddyBenchmark, "pgalloc.buddy-bench") {
+	bench_iterations = 0;
+	while (*value >= '0' && *value <= '9') {
+		bench_iterations = (bench_iterations * 10) + (*value++ - '0');
+	}
+}
 
 /**
  * A buddy page allocation algorithm.
+ *
+ * Each order has an intrusive, doubly-linked free list.  The forward link is the
+ * 'next_free' field of the block's first page descriptor, and the back-link is kept in
+ * a side table indexed by page-frame-number, since PageDescriptor has no room for it.
+ * Each order also has a bitmap with one bit per block, which is set if and only if that
+ * block is on the free list of that order.  Together these make every operation on a
+ * single block (insert, unlink, "is my buddy free?") constant time, so allocation,
+ * free and reservation cost at most O(MAX_ORDER), independent of how long the free
+ * lists grow.
+ *
+ * The side table and bitmaps are carved out of available memory during init().
+ *
+ * In front of the buddy lists sits a cache of small-order blocks for the CPU, so that the
+ * common order-0 allocations and frees do not split and merge blocks.  Each cache is a
+ * list whose head is hot (most recently freed) and whose tail is cold (most recently
+ * refilled from the buddy lists).  Allocations are served from the hot end; when a cache
+ * is empty it is refilled with a batch of blocks, and when it rises above the high
+ * watermark its cold end is drained back to the buddy lists down to the low watermark.
+ * InfOS brings up a single CPU, so there is a single set of caches.
  */
 class BuddyPageAllocator : public PageAllocatorAlgorithm {
+	friend PageDescriptor *buddy::alloc_pages_exact(uint64_t);
+	friend void buddy::free_pages_exact(PageDescriptor *, uint64_t);
+	friend unsigned int buddy::alloc_pages_bulk(unsigned int, PageDescriptor **);
+	friend bool buddy::active();
+
 private:
-    /**
-     * Returns the number of pages that comprise a 'block', in a given order.
-     * @param order The order to base the calculation off of.
-     * @return Returns the number of pages in a block, in the order.
-     */
-    static inline constexpr uint64_t pages_per_block(int order) {
-        /* The number of pages per block in a given order is simply 1, shifted left by the order number.
-         * For example, in order-2, there are (1 << 2) == 4 pages in each block.
-         */
-        return (1 << order);
-    }
-
-    /**
-     * Returns TRUE if the supplied page descriptor is correctly aligned for the
-     * given order.  Returns FALSE otherwise.
-     * @param pgd The page descriptor to test alignment for.
-     * @param order The order to use for calculations.
-     */
-    static inline bool is_correct_alignment_for_order(const PageDescriptor *pgd, int order) {
-        // Calculate the page-frame-number for the page descriptor, and return TRUE if
-        // it divides evenly into the number pages in a block of the given order.
-        return (sys.mm().pgalloc().pgd_to_pfn(pgd) % pages_per_block(order)) == 0;
-    }
-
-    /** Given a page descriptor, and an order, returns the buddy PGD.  The buddy could either be
-     * to the left or the right of PGD, in the given order.
-     * @param pgd The page descriptor to find the buddy for.
-     * @param order The order in which the page descriptor lives.
-     * @return Returns the buddy of the given page descriptor, in the given order.
-     */
-    PageDescriptor *buddy_of(PageDescriptor *pgd, int order) {
-        // (1) Make sure 'order' is within range
-        if (order >= MAX_ORDER) {
-            return NULL;
-        }
-
-        // (2) Check to make sure that PGD is correctly aligned in the order
-        if (!is_correct_alignment_for_order(pgd, order)) {
-            return NULL;
-        }
-
-        // (3) Calculate the page-frame-number of the buddy of this page.
-        // * If the PFN is aligned to the next order, then the buddy is the next block in THIS order.
-        // * If it's not aligned, then the buddy must be the previous block in THIS order.
-        uint64_t buddy_pfn = is_correct_alignment_for_order(pgd, order + 1) ?
-                             sys.mm().pgalloc().pgd_to_pfn(pgd) + pages_per_block(order) :
-                             sys.mm().pgalloc().pgd_to_pfn(pgd) - pages_per_block(order);
-
-        // (4) Return the page descriptor associated with the buddy page-frame-number.
-        return sys.mm().pgalloc().pfn_to_pgd(buddy_pfn);
-    }
-
-    /**
-     * Inserts a block into the free list of the given order.  The block is inserted in ascending order.
-     * @param pgd The page descriptor of the block to insert.
-     * @param order The order in which to insert the block.
-     * @return Returns the slot (i.e. a pointer to the pointer that points to the block) that the block
-     * was inserted into.
-     */
-    PageDescriptor **insert_block(PageDescriptor *pgd, int order) {
-        // Starting from the _free_area array, find the slot in which the page descriptor
-        // should be inserted.
-        PageDescriptor **slot = &_free_areas[order];
-
-        // Iterate whilst there is a slot, and whilst the page descriptor pointer is numerically
-        // greater than what the slot is pointing to.
-        while (*slot && pgd > *slot) {
-            slot = &(*slot)->next_free;
-        }
-
-        // Insert the page descriptor into the linked list.
-        pgd->next_free = *slot;
-        *slot = pgd;
-
-        // Return the insert point (i.e. slot)
-        return slot;
-    }
-
-    /**
-     * Removes a block from the free list of the given order.  The block MUST be present in the free-list, otherwise
-     * the system will panic.
-     * @param pgd The page descriptor of the block to remove.
-     * @param order The order in which to remove the block from.
-     */
-    void remove_block(PageDescriptor *pgd, int order) {
-        // Starting from the _free_area array, iterate until the block has been located in the linked-list.
-        PageDescriptor **slot = &_free_areas[order];
-        while (*slot && pgd != *slot) {
-            slot = &(*slot)->next_free;
-        }
-
-        // Make sure the block actually exists.  Panic the system if it does not.
-        assert(*slot == pgd);
-
-        // Remove the block from the free list.
-        *slot = pgd->next_free;
-        pgd->next_free = NULL;
-    }
-
-    /**
-     * Given a pointer to a block of free memory in the order "source_order", this function will
-     * split the block in half, and insert it into the order below.
-     * @param block_pointer A pointer to a pointer containing the beginning of a block of free memory.
-     * @param source_order The order in which the block of free memory exists.  Naturally,
-     * the split will insert the two new blocks into the order below.
-     * @return Returns the left-hand-side of the new block.
-     */
-    PageDescriptor *split_block(PageDescriptor **block_pointer, int source_order) {
-        // Make sure there is an incoming pointer.
-        assert(*block_pointer);
-
-        // Make sure the block_pointer is correctly aligned.
-        assert(is_correct_alignment_for_order(*block_pointer, source_order));
-
-        // TODO: Implement this function
-
-        //TODO: add error checking in here
-
-        int new_order = source_order - 1;
-
-        //split the block into two blocks
-        PageDescriptor *first = *block_pointer;
-        PageDescriptor *second = first + amount_of_block_pages;
-
-        uint64_t amount_of_block_pages = pages_per_block(new_order);
-
-        //remove the initial block
-        remove_block(block_pointer, source_order);
-        //insert both blocks into the an order less than the split_block
-        insert_block(first, new_order);
-        insert_block(second, new_order);
-
-        return first;
-    }
-
-    /**
-     * Takes a block in the given source order, and merges it (and it's buddy) into the next order.
-     * This function assumes both the source block and the buddy block are in the free list for the
-     * source order.  If they aren't this function will panic the system.
-     * @param block_pointer A pointer to a pointer containing a block in the pair to merge.
-     * @param source_order The order in which the pair of blocks live.
-     * @return Returns the new slot that points to the merged block.
-     */
-    PageDescriptor **merge_block(PageDescriptor **block_pointer, int source_order) {
-        assert(*block_pointer);
-
-        // Make sure the area_pointer is correctly aligned.
-        assert(is_correct_alignment_for_order(*block_pointer, source_order));
-
-        // TODO: Implement this function
-
-        // TODO add an error check in (especially around the free list assumption)
-        int new_order = source_order + 1;
-
-        //Get block one and two in the same order
-        PageDescriptor *first = *block_pointer;
-        PageDescriptor *second = buddy_of(first, source_order);
-
-        //Remove the old blocks: first and second
-        remove_block(first, source_order);
-        remove_block(second, source_order);
-
-        //Insert the new block in the new order according to which buddy was called
-        if (first > second) {
-            insert_block(second, new_order);
-        } else {
-            insert_block(first, new_order);
-        }
-
-    }
+	/**
+	 * Returns the number of pages that comprise a 'block', in a given order.
+	 * @param order The order to base the calculation off of.
+	 * @return Returns the number of pages in a block, in the order.
+	 */
+	static inline constexpr uint64_t pages_per_block(int order) {
+		/* The number of pages per block in a given order is simply 1, shifted left by the order number.
+		 * For example, in order-2, there are (1 << 2) == 4 pages in each block.
+		 */
+		return (1ull << order);
+	}
+
+	/**
+	 * Returns the smallest order whose blocks hold at least the given number of pages.
+	 */
+	static int ilog2_ceil(uint64_t nr_pages) {
+		int order = 0;
+		while (pages_per_block(order) < nr_pages) {
+			order++;
+		}
+
+		return order;
+	}
+
+	/**
+	 * Returns the page-frame-number of a page descriptor.
+	 */
+	inline pfn_t pfn_of(const PageDescriptor *pgd) const {
+		return (pfn_t)(pgd - _page_descriptors);
+	}
+
+	/**
+	 * Returns the page descriptor of a page-frame-number.
+	 */
+	inline PageDescriptor *pgd_of(pfn_t pfn) const {
+		return &_page_descriptors[pfn];
+	}
+
+	/**
+	 * Returns TRUE if the supplied page descriptor is correctly aligned for the
+	 * given order.  Returns FALSE otherwise.
+	 * @param pgd The page descriptor to test alignment for.
+	 * @param order The order to use for calculations.
+	 */
+	inline bool is_correct_alignment_for_order(const PageDescriptor *pgd, int order) const {
+		// Calculate the page-frame-number for the page descriptor, and return TRUE if
+		// it divides evenly into the number pages in a block of the given order.
+		return (pfn_of(pgd) & (pages_per_block(order) - 1)) == 0;
+	}
+
+	/**
+	 * Given a page descriptor, and an order, returns the buddy PGD.  The buddy could either be
+	 * to the left or the right of PGD, in the given order.
+	 * @param pgd The page descriptor to find the buddy for.
+	 * @param order The order in which the page descriptor lives.
+	 * @return Returns the buddy of the given page descriptor, in the given order, or NULL if
+	 * the buddy would lie (partly) beyond the end of memory.
+	 */
+	PageDescriptor *buddy_of(PageDescriptor *pgd, int order) const {
+		// (1) Make sure 'order' is within range.  The top order has no buddies.
+		if (order >= MAX_ORDER - 1) {
+			return NULL;
+		}
+
+		// (2) Check to make sure that PGD is correctly aligned in the order
+		if (!is_correct_alignment_for_order(pgd, order)) {
+			return NULL;
+		}
+
+		// (3) The buddy differs from this block only in the bit that selects the
+		// left or right half of the block in the order above.
+		pfn_t buddy_pfn = pfn_of(pgd) ^ pages_per_block(order);
+		if (buddy_pfn + pages_per_block(order) > _nr_pages) {
+			return NULL;
+		}
+
+		// (4) Return the page descriptor associated with the buddy page-frame-number.
+		return pgd_of(buddy_pfn);
+	}
+
+	/**
+	 * Returns TRUE if the given block is on the free list of the given order.
+	 */
+	inline bool is_free_block(const PageDescriptor *pgd, int order) const {
+		pfn_t index = pfn_of(pgd) >> order;
+		return (_free_bitmaps[order][index / 64] >> (index % 64)) & 1;
+	}
+
+	/**
+	 * Sets or clears the free bit of the given block, in the given order.
+	 */
+	inline void set_free_block(const PageDescriptor *pgd, int order, bool free) {
+		pfn_t index = pfn_of(pgd) >> order;
+
+		if (free) {
+			_free_bitmaps[order][index / 64] |= (1ull << (index % 64));
+		} else {
+			_free_bitmaps[order][index / 64] &= ~(1ull << (index % 64));
+		}
+	}
+
+	/**
+	 * Inserts a block at the head of the free list of the given order.
+	 * @param pgd The page descriptor of the block to insert.
+	 * @param order The order in which to insert the block.
+	 */
+	void insert_block(PageDescriptor *pgd, int order) {
+		assert(is_correct_alignment_for_order(pgd, order));
+		assert(!is_free_block(pgd, order));
+
+		PageDescriptor *head = _free_areas[order];
+
+		pgd->next_free = head;
+		_prev[pfn_of(pgd)] = NO_PFN;
+
+		if (head) {
+			_prev[pfn_of(head)] = (uint32_t)pfn_of(pgd);
+		}
+
+		_free_areas[order] = pgd;
+		_nonempty_orders |= (1u << order);
+
+		set_free_block(pgd, order, true);
+		_nr_free_pages += pages_per_block(order);
+	}
+
+	/**
+	 * Removes a block from the free list of the given order.  The block MUST be present in the free-list, otherwise
+	 * the system will panic.
+	 * @param pgd The page descriptor of the block to remove.
+	 * @param order The order in which to remove the block from.
+	 */
+	void remove_block(PageDescriptor *pgd, int order) {
+		// Make sure the block actually exists.  Panic the system if it does not.
+		assert(is_free_block(pgd, order));
+
+		uint32_t prev = _prev[pfn_of(pgd)];
+		PageDescriptor *next = pgd->next_free;
+
+		if (prev == NO_PFN) {
+			assert(_free_areas[order] == pgd);
+			_free_areas[order] = next;
+
+			if (!next) {
+				_nonempty_orders &= ~(1u << order);
+			}
+		} else {
+			pgd_of(prev)->next_free = next;
+		}
+
+		if (next) {
+			_prev[pfn_of(next)] = prev;
+		}
+
+		pgd->next_free = NULL;
+
+		set_free_block(pgd, order, false);
+		_nr_free_pages -= pages_per_block(order);
+	}
+
+	/**
+	 * Splits a block that has already been taken off the free lists in half, and returns
+	 * the right-hand half to the free list of the order below.
+	 * @param pgd The page descriptor of the block to split.
+	 * @param source_order The order of the block.
+	 * @return Returns the left-hand half of the block, which is NOT on any free list.
+	 */
+	PageDescriptor *split_block(PageDescriptor *pgd, int source_order) {
+		assert(source_order > 0);
+		assert(is_correct_alignment_for_order(pgd, source_order));
+
+		int new_order = source_order - 1;
+		insert_block(pgd + pages_per_block(new_order), new_order);
+
+		_nr_splits++;
+		return pgd;
+	}
+
+	/**
+	 * Allocates a block of the given order directly from the buddy lists.
+	 * @param order The order of the block to allocate.
+	 * @return Returns the first page descriptor of the block, or NULL if there is no free memory.
+	 */
+	PageDescriptor *alloc_block(int order) {
+		// Find the lowest order, at or above the requested one, that has a free block.
+		uint32_t candidates = _nonempty_orders >> order;
+		if (!candidates) {
+			return NULL;
+		}
+
+		int source_order = order + __builtin_ctz(candidates);
+
+		PageDescriptor *pgd = _free_areas[source_order];
+		remove_block(pgd, source_order);
+
+		// Repeatedly split the block, handing back the right-hand halves, until it is the
+		// requested size.
+		while (source_order > order) {
+			pgd = split_block(pgd, source_order);
+			source_order--;
+		}
+
+		return pgd;
+	}
+
+	/**
+	 * Returns a block of the given order directly to the buddy lists, merging it with
+	 * its buddies where possible.
+	 * @param pgd The first page descriptor of the block.
+	 * @param order The order of the block.
+	 */
+	void free_block(PageDescriptor *pgd, int order) {
+		// Whilst the buddy is free, take it off its free list and merge it with this block.
+		PageDescriptor *buddy;
+		while ((buddy = buddy_of(pgd, order)) != NULL && is_free_block(buddy, order)) {
+			remove_block(buddy, order);
+
+			if (buddy < pgd) {
+				pgd = buddy;
+			}
+
+			order++;
+			_nr_merges++;
+		}
+
+		insert_block(pgd, order);
+	}
+
+	/**
+	 * A cache of free blocks of one order.  The blocks are linked through 'next_free' and
+	 * the back-link table, which are unused whilst a block is off the buddy lists.
+	 */
+	struct PageCache {
+		PageDescriptor *head;	// Hot end
+		PageDescriptor *tail;	// Cold end
+		unsigned int count;
+	};
+
+	/**
+	 * Returns the number of blocks a page cache batch (or watermark) of 'pages' pages
+	 * corresponds to, in the given order.
+	 */
+	static inline unsigned int pcp_blocks(unsigned int pages, int order) {
+		unsigned int blocks = pages >> order;
+		return blocks ? blocks : 1;
+	}
+
+	void cache_push_head(PageCache& cache, PageDescriptor *pgd) {
+		pgd->next_free = cache.head;
+		_prev[pfn_of(pgd)] = NO_PFN;
+
+		if (cache.head) {
+			_prev[pfn_of(cache.head)] = (uint32_t)pfn_of(pgd);
+		} else {
+			cache.tail = pgd;
+		}
+
+		cache.head = pgd;
+		cache.count++;
+		_nr_cached_pages += pages_per_block(&cache - _caches);
+	}
+
+	void cache_push_tail(PageCache& cache, PageDescriptor *pgd) {
+		pgd->next_free = NULL;
+		_prev[pfn_of(pgd)] = cache.tail ? (uint32_t)pfn_of(cache.tail) : NO_PFN;
+
+		if (cache.tail) {
+			cache.tail->next_free = pgd;
+		} else {
+			cache.head = pgd;
+		}
+
+		cache.tail = pgd;
+		cache.count++;
+		_nr_cached_pages += pages_per_block(&cache - _caches);
+	}
+
+	PageDescriptor *cache_pop_head(PageCache& cache) {
+		PageDescriptor *pgd = cache.head;
+
+		cache.head = pgd->next_free;
+		if (cache.head) {
+			_prev[pfn_of(cache.head)] = NO_PFN;
+		} else {
+			cache.tail = NULL;
+		}
+
+		pgd->next_free = NULL;
+		cache.count--;
+		_nr_cached_pages -= pages_per_block(&cache - _caches);
+
+		return pgd;
+	}
+
+	PageDescriptor *cache_pop_tail(PageCache& cache) {
+		PageDescriptor *pgd = cache.tail;
+		uint32_t prev = _prev[pfn_of(pgd)];
+
+		cache.tail = (prev == NO_PFN) ? NULL : pgd_of(prev);
+		if (cache.tail) {
+			cache.tail->next_free = NULL;
+		} else {
+			cache.head = NULL;
+		}
+
+		cache.count--;
+		_nr_cached_pages -= pages_per_block(&cache - _caches);
+
+		return pgd;
+	}
+
+	/**
+	 * Refills an empty page cache with a batch of blocks from the buddy lists.  The new
+	 * blocks go on the cold end.
+	 */
+	void refill_cache(int order) {
+		PageCache& cache = _caches[order];
+
+		for (unsigned int i = 0; i < pcp_blocks(PCP_BATCH, order); i++) {
+			PageDescriptor *pgd = alloc_block(order);
+			if (!pgd) {
+				break;
+			}
+
+			cache_push_tail(cache, pgd);
+		}
+
+		_nr_pcp_refills++;
+	}
+
+	/**
+	 * Returns blocks from the cold end of a page cache to the buddy lists, until the cache
+	 * holds no more than 'target' blocks.
+	 */
+	void drain_cache(int order, unsigned int target) {
+		PageCache& cache = _caches[order];
+
+		while (cache.count > target) {
+			free_block(cache_pop_tail(cache), order);
+		}
+
+		_nr_pcp_drains++;
+	}
+
+	/**
+	 * Returns every cached block to the buddy lists.
+	 */
+	void drain_all_caches() {
+		for (int order = 0; order < PCP_ORDERS; order++) {
+			if (_caches[order].count) {
+				drain_cache(order, 0);
+			}
+		}
+	}
+
+	/**
+	 * Populates the free lists with the largest aligned blocks that cover the range of pages
+	 * [start, end).  The range is walked from the top down, so that when the lists are
+	 * complete, the lower addresses sit at the head of each list.
+	 */
+	void insert_range(pfn_t start, pfn_t end) {
+		pfn_t pfn = end;
+
+		while (pfn > start) {
+			int order = __builtin_ctzll(pfn);
+			if (order > MAX_ORDER - 1) {
+				order = MAX_ORDER - 1;
+			}
+
+			while (pfn - pages_per_block(order) < start) {
+				order--;
+			}
+
+			pfn -= pages_per_block(order);
+			insert_block(pgd_of(pfn), order);
+		}
+	}
+
+	/**
+	 * Returns the range of pages [start, end) to the buddy lists as the largest aligned
+	 * blocks that cover it, merging each block with its buddies where possible.
+	 */
+	void free_range(pfn_t start, pfn_t end) {
+		pfn_t pfn = start;
+
+		while (pfn < end) {
+			int order = pfn ? __builtin_ctzll(pfn) : MAX_ORDER - 1;
+			if (order > MAX_ORDER - 1) {
+				order = MAX_ORDER - 1;
+			}
+
+			while (pfn + pages_per_block(order) > end) {
+				order--;
+			}
+
+			free_block(pgd_of(pfn), order);
+			pfn += pages_per_block(order);
+		}
+	}
+
+	/**
+	 * Allocates a number of single pages, which need not be contiguous, in one pass.  Pages
+	 * are taken from the order-0 page cache first, and then from the buddy lists a whole
+	 * block at a time, preferring the largest free block that does not overshoot the
+	 * request, so that large requests do not split and re-merge one page at a time.
+	 * @param nr_pages The number of pages to allocate.
+	 * @param pages The array that receives the page descriptors.
+	 * @return Returns the number of pages allocated, which is less than nr_pages only if
+	 * memory ran out.
+	 */
+	unsigned int alloc_pages_bulk(unsigned int nr_pages, PageDescriptor **pages) {
+		unsigned int count = 0;
+
+		while (count < nr_pages) {
+			if (pcp_enabled && _caches[0].count) {
+				pages[count++] = cache_pop_head(_caches[0]);
+				_nr_pcp_hits++;
+				continue;
+			}
+
+			int order = 63 - __builtin_clzll(nr_pages - count);
+			if (order > MAX_ORDER - 1) {
+				order = MAX_ORDER - 1;
+			}
+
+			// Take the largest free block that fits whole, or failing that, split one down.
+			PageDescriptor *block;
+			uint32_t fitting = _nonempty_orders & ((2u << order) - 1);
+
+			if (fitting) {
+				order = 31 - __builtin_clz(fitting);
+				block = _free_areas[order];
+				remove_block(block, order);
+			} else {
+				block = alloc_block(order);
+			}
+
+			if (!block) {
+				if (!_nr_cached_pages) {
+					break;
+				}
+
+				drain_all_caches();
+				continue;
+			}
+
+			for (uint64_t i = 0; i < pages_per_block(order); i++) {
+				pages[count++] = block + i;
+			}
+		}
+
+		return count;
+	}
+
+	/**
+	 * Allocates exactly the given number of contiguous pages.  A block of the next power of
+	 * two is taken from the buddy lists, and the pages beyond the request are given back
+	 * straight away.
+	 * @param nr_pages The number of contiguous pages to allocate.
+	 * @return Returns the first page descriptor of the range, or NULL if allocation failed.
+	 */
+	PageDescriptor *alloc_pages_exact(uint64_t nr_pages) {
+		if (nr_pages == 0) {
+			return NULL;
+		}
+
+		int order = ilog2_ceil(nr_pages);
+		if (order >= MAX_ORDER) {
+			return NULL;
+		}
+
+		PageDescriptor *pgd = alloc_block(order);
+		if (!pgd && _nr_cached_pages) {
+			drain_all_caches();
+			pgd = alloc_block(order);
+		}
+
+		if (!pgd) {
+			return NULL;
+		}
+
+		pfn_t pfn = pfn_of(pgd);
+		free_range(pfn + nr_pages, pfn + pages_per_block(order));
+
+		return pgd;
+	}
+
+	/**
+	 * Frees a range of pages allocated with alloc_pages_exact().
+	 * @param pgd The first page descriptor of the range.
+	 * @param nr_pages The number of pages that were allocated.
+	 */
+	void free_pages_exact(PageDescriptor *pgd, uint64_t nr_pages) {
+		pfn_t pfn = pfn_of(pgd);
+		free_range(pfn, pfn + nr_pages);
+	}
+
+	/**
+	 * Finds and claims a run of available pages that can hold the back-link table and
+	 * the free bitmaps.  The pages must be reachable through the kernel mapping, which
+	 * is the only one that exists at this point.
+	 * @param nr_pages The number of pages required.
+	 * @return Returns the first page-frame-number of the run, or NO_PFN if there is no
+	 * suitable run.
+	 */
+	pfn_t claim_metadata_pages(uint64_t nr_pages) {
+		// Start looking after the page descriptor array, which is where the heap begins.
+		pfn_t first = pa_to_pfn(kva_to_pa((virt_addr_t)&_page_descriptors[_nr_pages])) + 1;
+		pfn_t limit = pa_to_pfn(KERNEL_VMEM_SIZE);
+
+		if (limit > _nr_pages) {
+			limit = _nr_pages;
+		}
+
+		uint64_t run = 0;
+		for (pfn_t pfn = first; pfn < limit; pfn++) {
+			if (_page_descriptors[pfn].type != PageDescriptorType::AVAILABLE) {
+				run = 0;
+				continue;
+			}
+
+			if (++run == nr_pages) {
+				pfn_t base = pfn + 1 - nr_pages;
+
+				// Mark the pages as reserved, so that they are never handed to the free lists.
+				for (pfn_t i = base; i <= pfn; i++) {
+					_page_descriptors[i].type = PageDescriptorType::RESERVED;
+				}
+
+				return base;
+			}
+		}
+
+		return NO_PFN;
+	}
+
+	/**
+	 * Runs a randomised allocate/free workload against the allocator, and reports the
+	 * achieved rate.  The allocator is returned to its initial state afterwards.
+	 * @param iterations The number of allocate-or-free operations to perform.
+	 * @param label A name for this run, to go in the log.
+	 */
+	void run_benchmark_pass(uint64_t iterations, const char *label) {
+		static PageDescriptor *slots[BENCH_SLOTS];
+		static int slot_orders[BENCH_SLOTS];
+
+		uint64_t nr_free_before = _nr_free_pages + _nr_cached_pages;
+		uint64_t splits_before = _nr_splits, merges_before = _nr_merges;
+		uint64_t nr_allocs = 0, nr_frees = 0, nr_failed = 0;
+		uint32_t seed = 0x2545f491;
+
+		// Phase one: a tight order-0 allocate/free loop, which is the common case.
+		uint64_t start = read_cycle_counter();
+		for (uint64_t i = 0; i < iterations; i++) {
+			PageDescriptor *pgd = alloc_pages(0);
+			assert(pgd);
+			free_pages(pgd, 0);
+		}
+		uint64_t order0_cycles = read_cycle_counter() - start;
+
+		// Phase two: random slots are allocated (with a random small order) or freed, so
+		// the free lists fill up with fragments and blocks are continually split and merged.
+		start = read_cycle_counter();
+		for (uint64_t i = 0; i < iterations; i++) {
+			seed = (seed * 1103515245) + 12345;
+			unsigned int slot = (seed >> 8) % BENCH_SLOTS;
+
+			if (slots[slot]) {
+				free_pages(slots[slot], slot_orders[slot]);
+				slots[slot] = NULL;
+				nr_frees++;
+			} else {
+				slot_orders[slot] = (seed >> 24) % (BENCH_MAX_ORDER + 1);
+				slots[slot] = alloc_pages(slot_orders[slot]);
+
+				if (slots[slot]) {
+					nr_allocs++;
+				} else {
+					nr_failed++;
+				}
+			}
+		}
+		uint64_t mixed_cycles = read_cycle_counter() - start;
+
+		for (unsigned int slot = 0; slot < BENCH_SLOTS; slot++) {
+			if (slots[slot]) {
+				free_pages(slots[slot], slot_orders[slot]);
+				slots[slot] = NULL;
+			}
+		}
+
+		drain_all_caches();
+		assert(_nr_free_pages == nr_free_before);
+
+		mm_log.messagef(LogLevel::INFO, "buddy (%s): %lu order-0 alloc/free pairs in %lu cycles (%lu cycles/pair)",
+						label, iterations, order0_cycles, order0_cycles / iterations);
+		mm_log.messagef(LogLevel::INFO, "buddy (%s): %lu mixed-order ops (%lu allocs, %lu frees, %lu failed) in %lu cycles (%lu cycles/op)",
+						label, iterations, nr_allocs, nr_frees, nr_failed, mixed_cycles, mixed_cycles / iterations);
+		mm_log.messagef(LogLevel::INFO, "buddy (%s): %lu splits, %lu merges",
+						label, _nr_splits - splits_before, _nr_merges - merges_before);
+	}
+
+	/**
+	 * Compares bulk allocation with allocating the same pages one at a time.  The allocator
+	 * is returned to its initial state afterwards.
+	 * @param iterations The number of pages to allocate in each half of the comparison.
+	 */
+	void run_bulk_benchmark(uint64_t iterations) {
+		static PageDescriptor *pages[BENCH_BULK_PAGES];
+
+		drain_all_caches();
+		uint64_t nr_free_before = _nr_free_pages;
+		uint64_t rounds = (iterations / BENCH_BULK_PAGES) + 1;
+
+		uint64_t start = read_cycle_counter();
+		for (uint64_t i = 0; i < rounds; i++) {
+			for (unsigned int j = 0; j < BENCH_BULK_PAGES; j++) {
+				pages[j] = alloc_pages(0);
+				assert(pages[j]);
+			}
+
+			for (unsigned int j = 0; j < BENCH_BULK_PAGES; j++) {
+				free_pages(pages[j], 0);
+			}
+		}
+		uint64_t single_cycles = read_cycle_counter() - start;
+
+		start = read_cycle_counter();
+		for (uint64_t i = 0; i < rounds; i++) {
+			unsigned int nr = alloc_pages_bulk(BENCH_BULK_PAGES, pages);
+			assert(nr == BENCH_BULK_PAGES);
+
+			for (unsigned int j = 0; j < nr; j++) {
+				free_pages(pages[j], 0);
+			}
+		}
+		uint64_t bulk_cycles = read_cycle_counter() - start;
+
+		drain_all_caches();
+		assert(_nr_free_pages == nr_free_before);
+
+		uint64_t nr_pages = rounds * BENCH_BULK_PAGES;
+		mm_log.messagef(LogLevel::INFO, "buddy: %lu pages one at a time in %lu cycles (%lu cycles/page), in bulk in %lu cycles (%lu cycles/page)",
+						nr_pages, single_cycles, single_cycles / nr_pages, bulk_cycles, bulk_cycles / nr_pages);
+	}
+
+	/**
+	 * Checks that exact allocations hold only the pages they asked for.  The allocator is
+	 * returned to its initial state afterwards.
+	 */
+	void run_exact_benchmark() {
+		static PageDescriptor *pages[BENCH_EXACT_PAGES];
+
+		drain_all_caches();
+		uint64_t nr_free_before = _nr_free_pages;
+
+		// Hold an exact allocation of every size up to BENCH_EXACT_PAGES at once, and check
+		// that only the requested pages left the free lists.
+		uint64_t nr_requested = 0, nr_rounded = 0;
+		uint64_t start = read_cycle_counter();
+		for (unsigned int j = 0; j < BENCH_EXACT_PAGES; j++) {
+			pages[j] = alloc_pages_exact(j + 1);
+			assert(pages[j]);
+
+			nr_requested += j + 1;
+			nr_rounded += pages_per_block(ilog2_ceil(j + 1));
+		}
+
+		uint64_t nr_held = nr_free_before - _nr_free_pages;
+
+		for (unsigned int j = 0; j < BENCH_EXACT_PAGES; j++) {
+			free_pages_exact(pages[j], j + 1);
+		}
+		uint64_t exact_cycles = read_cycle_counter() - start;
+
+		assert(nr_held == nr_requested);
+		assert(_nr_free_pages == nr_free_before);
+
+		mm_log.messagef(LogLevel::INFO, "buddy: exact allocations of 1..%u pages held %lu pages, rather than %lu in power-of-two blocks, in %lu cycles",
+						BENCH_EXACT_PAGES, nr_held, nr_rounded, exact_cycles);
+	}
+
+	/**
+	 * Runs the benchmark against the bare buddy lists, and then with the page caches in
+	 * front of them, if they are enabled.
+	 */
+	void run_benchmark(uint64_t iterations) {
+		bool use_caches = pcp_enabled;
+
+		pcp_enabled = false;
+		run_benchmark_pass(iterations, "no page caches");
+
+		if (use_caches) {
+			pcp_enabled = true;
+			run_benchmark_pass(iterations, "page caches");
+		}
+
+		run_bulk_benchmark(iterations);
+		run_exact_benchmark();
+	}
 
 public:
-    /**
-     * Constructs a new instance of the Buddy Page Allocator.
-     */
-    BuddyPageAllocator() {
-        // Iterate over each free area, and clear it.
-        for (unsigned int i = 0; i < ARRAY_SIZE(_free_areas); i++) {
-            _free_areas[i] = NULL;
-        }
-    }
-
-    /**
-     * Allocates 2^order number of contiguous pages
-     * @param order The power of two, of the number of contiguous pages to allocate.
-     * @return Returns a pointer to the first page descriptor for the newly allocated page range, or NULL if
-     * allocation failed.
-     */
-    PageDescriptor *alloc_pages(int order) override {
-
-        //Need to find the highest order above the given one that is not empty
-        int ord = order++;
-        while (NULL == free_areas[ord]) {
-            if (ord >= MAX_ORDER) {
-                return NULL;
-            }
-            ord++;
-        }
-
-        PageDescriptor *pgd = _free_areas[o];
-
-        //Need to repeatedly split blocks until target order is reached
-        for (int i = ord; i > order; i--) {
-            pgd = split_block(&pgd, i);
-        }
-        //TODO add more error checking
-        remove_block(pgd, order);
-
-        return pgd;
-    }
-
-    /**
-     * Frees 2^order contiguous pages.
-     * @param pgd A pointer to an array of page descriptors to be freed.
-     * @param order The power of two number of contiguous pages to free.
-     */
-    void free_pages(PageDescriptor *pgd, int order) override {
-        // Make sure that the incoming page descriptor is correctly aligned
-        // for the order on which it is being freed, for example, it is
-        // illegal to free page 1 in order-1.
-        assert(is_correct_alignment_for_order(pgd, order));
-
-
-        PageDescriptor **added_block = insert_block(pgd, order);
-        PageDescriptor *buddy_potential = _free_areas[order];
-        PageDescriptor *buddy_of = buddy_of(*added_block, order);
-
-
-        //Need to look at the neighbouring block (buddy) to see if it is free too
-        for (int i = order; i < MAX_ORDER; i++) {
-            if (buddy_potential) {
-                //Stop if a non-free neighbour block is encountered in buddy_potential
-                break;
-            } else if (buddy_of == buddy_potential) {
-                //If the neighbouring block is free too, combine the two
-                added_block = merge_block(added_block, i);
-                buddy_potential = _free_areas[i];
-                buddy_of = buddy_of(*added_block, i);
-            } else {
-                //Otherwise move onto the next block in the current order
-                buddy_potential = buddy_potential->next_free;
-                i--;
-            }
-        }
-    }
-
-
-    /**
-     * Reserves a specific page, so that it cannot be allocated.
-     * @param pgd The page descriptor of the page to reserve.
-     * @return Returns TRUE if the reservation was successful, FALSE otherwise.
-     */
-    bool reserve_page(PageDescriptor *pgd) {
-
-        int pdg_found = false;
-        PageDescriptor *current_block, *pdg_in_block;
-
-        //Loops through the each order to check if the page is in that order
-        for (int i = 0; i < MAX_ORDER; i++) {
-            if (!pdg_found) {
-                //If the page hasn't been found it sets the current block to the next free area in the order
-                current_block = _free_areas[i];
-
-                while (current_block) {
-                    if (((pdg < (pages_per_block(i) + current_block)) && (pdg >= current_block))) {
-
-                        pdg_in_block = current_block;
-
-                        //If the page is in the current block it split the block to find the page to be reserved
-                        while ( i > 0 ) {
-                            block_w_pgd = split_block(&block_w_pgd, i);
-                            i--;
-                            if (!((pdg < (pages_per_block(order) + current_block)) && (pdg >= current_block))) {
-                                //It checks that the page is in the current block otherwise it swaps to the buddy to split
-                                pdg_in_block = buddy_of(block_w_pgd, order);
-                            }
-                        }
-                        pdg_found = true;
-                        assert(is_correct_alignment_for_order(block_w_pgd, 0));
-                        assert(pdg_in_block == pgd);
-                        break;
-                    } else {
-                        //If the page is not in the current block it sets the current_block to the next free and the loop continues
-                        current_block = current_block->next_free;
-                    }
-                }
-            } else {
-                //If the page is found the loop breaks for efficiency
-                break;
-            }
-        }
-
-        remove_block(pgd, 0);
-
-        return pdg_found;
-
-
-    }
-
-    /**
-     * Initialises the allocation algorithm.
-     * @return Returns TRUE if the algorithm was successfully initialised, FALSE otherwise.
-     */
-    bool init(PageDescriptor *page_descriptors, uint64_t nr_page_descriptors) override {
-        // mm_log.messagef(LogLevel::DEBUG, "Buddy Allocator Initialising pd=%p, nr=0x%lx", page_descriptors, nr_page_descriptors);
-
-        // TODO: Initialise the free area linked list for the maximum order
-        // to initialise the allocation algorithm.
-
-        PageDescriptor *pgd;
-        int remaining_pdgs = nr_page_descriptors;
-        uint64_t indx_for_pdg = 0;
-        int order = MAX_ORDER - 1;
-        int blocks;
-        int remaining_blocks;
-
-        //Loop until finished with blocks divided for each order
-        while ((remaining_pdgs > 0) && (order >= 0) && (indx_for_pdg < nr_page_descriptors)) {
-
-            remaining_blocks = remaining_pdgs % pages_per_block(order);
-            blocks = remaining_pdgs / pages_per_block(order);
-
-            //Set the pointer to the first free page in the order and then for each set linked lists
-            if (blocks > 0) {
-                _free_areas[order] = &page_descriptors[indx_for_pdg];
-                pgd = _free_areas[order];
-
-                for (int i = 1; i < blocks; i++) {
-                    indx_for_pdg += pages_per_block(order);
-                    pgd->next_free = &page_descriptors[indx_for_pdg];
-                    pgd = pgd->next_free;
-                }
-
-            }
-
-        }
-        return true;
-    }
+	/**
+	 * Constructs a new instance of the Buddy Page Allocator.
+	 */
+	BuddyPageAllocator() : _page_descriptors(NULL), _nr_pages(0), _prev(NULL), _nonempty_orders(0), _caches_deferred(false),
+		_nr_free_pages(0), _nr_cached_pages(0), _nr_splits(0), _nr_merges(0),
+		_nr_pcp_hits(0), _nr_pcp_refills(0), _nr_pcp_drains(0) {
+		// Iterate over each free area, and clear it.
+		for (unsigned int i = 0; i < ARRAY_SIZE(_free_areas); i++) {
+			_free_areas[i] = NULL;
+			_free_bitmaps[i] = NULL;
+		}
+
+		for (unsigned int i = 0; i < ARRAY_SIZE(_caches); i++) {
+			_caches[i].head = NULL;
+			_caches[i].tail = NULL;
+			_caches[i].count = 0;
+		}
+
+		instance = this;
+	}
+
+	/**
+	 * Allocates 2^order number of contiguous pages
+	 * @param order The power of two, of the number of contiguous pages to allocate.
+	 * @return Returns a pointer to the first page descriptor for the newly allocated page range, or NULL if
+	 * allocation failed.
+	 */
+	PageDescriptor *alloc_pages(int order) override {
+		if (order < 0 || order >= MAX_ORDER) {
+			return NULL;
+		}
+
+		// The page allocator serialises its callers with a mutex that the exact allocation
+		// functions in buddy.h cannot take, so the lists are also guarded by the IRQ lock.
+		UniqueIRQLock l;
+
+		if (pcp_enabled && order < PCP_ORDERS) {
+			PageCache& cache = _caches[order];
+
+			if (cache.count) {
+				_nr_pcp_hits++;
+				return cache_pop_head(cache);
+			}
+
+			refill_cache(order);
+			if (cache.count) {
+				return cache_pop_head(cache);
+			}
+		} else {
+			PageDescriptor *pgd = alloc_block(order);
+			if (pgd) {
+				return pgd;
+			}
+		}
+
+		// The buddy lists are exhausted, but memory may still be held in the page caches of
+		// other orders.  Give it back, so it can be merged, and try once more.
+		if (!_nr_cached_pages) {
+			return NULL;
+		}
+
+		drain_all_caches();
+		return alloc_block(order);
+	}
+
+	/**
+	 * Frees 2^order contiguous pages.
+	 * @param pgd A pointer to an array of page descriptors to be freed.
+	 * @param order The power of two number of contiguous pages to free.
+	 */
+	void free_pages(PageDescriptor *pgd, int order) override {
+		// Make sure that the incoming page descriptor is correctly aligned
+		// for the order on which it is being freed, for example, it is
+		// illegal to free page 1 in order-1.
+		assert(is_correct_alignment_for_order(pgd, order));
+
+		UniqueIRQLock l;
+
+		if (pcp_enabled && order < PCP_ORDERS) {
+			PageCache& cache = _caches[order];
+			cache_push_head(cache, pgd);
+
+			if (cache.count > pcp_blocks(PCP_HIGH_WATERMARK, order)) {
+				drain_cache(order, pcp_blocks(PCP_LOW_WATERMARK, order));
+			}
+
+			return;
+		}
+
+		free_block(pgd, order);
+	}
+
+	/**
+	 * Reserves a specific page, so that it cannot be allocated.
+	 * @param pgd The page descriptor of the page to reserve.
+	 * @return Returns TRUE if the reservation was successful, FALSE otherwise.
+	 */
+	bool reserve_page(PageDescriptor *pgd) override {
+		UniqueIRQLock l;
+		pfn_t pfn = pfn_of(pgd);
+
+		// Page zero is the first page the kernel reserves once its self-test is over.  The
+		// self-test reserves pages of its own, but never page zero, which the kernel keeps.
+		if (_caches_deferred && pfn == 0) {
+			_caches_deferred = false;
+			pcp_enabled = true;
+		}
+
+		// The page may be sitting in a page cache, so give those back to the buddy lists first.
+		drain_all_caches();
+
+		// Look for the free block containing the page, which at each order can only be the
+		// block the page is aligned down to.
+		for (int order = 0; order < MAX_ORDER; order++) {
+			PageDescriptor *block = pgd_of(pfn & ~(pages_per_block(order) - 1));
+			if (!is_free_block(block, order)) {
+				continue;
+			}
+
+			remove_block(block, order);
+
+			// Split the block down to a single page, freeing whichever half does not
+			// contain the page being reserved.
+			while (order > 0) {
+				order--;
+
+				PageDescriptor *right = block + pages_per_block(order);
+				if (pgd >= right) {
+					insert_block(block, order);
+					block = right;
+				} else {
+					insert_block(right, order);
+				}
+
+				_nr_splits++;
+			}
+
+			assert(block == pgd);
+			return true;
+		}
+
+		// The page is not free.  Pages that were never available (holes, the kernel image, etc.)
+		// were never given to the free lists, so they are already reserved.
+		return pgd->type != PageDescriptorType::AVAILABLE;
+	}
+
+	/**
+	 * Initialises the allocation algorithm.
+	 * @return Returns TRUE if the algorithm was successfully initialised, FALSE otherwise.
+	 */
+	bool init(PageDescriptor *page_descriptors, uint64_t nr_page_descriptors) override {
+		mm_log.messagef(LogLevel::DEBUG, "Buddy Allocator Initialising pd=%p, nr=0x%lx", page_descriptors, nr_page_descriptors);
+
+		_page_descriptors = page_descriptors;
+		_nr_pages = nr_page_descriptors;
+
+		// The back-link table stores 32-bit page-frame-numbers.
+		if (_nr_pages >= NO_PFN) {
+			mm_log.messagef(LogLevel::ERROR, "Buddy Allocator cannot manage 0x%lx pages", _nr_pages);
+			return false;
+		}
+
+		// Work out how much space the back-link table and the bitmaps need.
+		uint64_t bitmap_words[MAX_ORDER];
+		uint64_t metadata_size = _nr_pages * sizeof(uint32_t);
+
+		for (int order = 0; order < MAX_ORDER; order++) {
+			bitmap_words[order] = ((_nr_pages >> order) / 64) + 1;
+			metadata_size += bitmap_words[order] * sizeof(uint64_t);
+		}
+
+		uint64_t metadata_pages = (metadata_size + __page_size - 1) >> __page_bits;
+
+		pfn_t metadata_pfn = claim_metadata_pages(metadata_pages);
+		if (metadata_pfn == NO_PFN) {
+			mm_log.messagef(LogLevel::ERROR, "Buddy Allocator could not find %lu pages for its free bitmaps", metadata_pages);
+			return false;
+		}
+
+		mm_log.messagef(LogLevel::DEBUG, "Buddy Allocator metadata: %lu pages @ pfn=%lx", metadata_pages, metadata_pfn);
+
+		// Lay out the bitmaps first, as they need eight-byte alignment, followed by the back-links.
+		uint64_t *metadata = (uint64_t *)pa_to_kva(pfn_to_pa(metadata_pfn));
+		bzero(metadata, metadata_pages << __page_bits);
+
+		for (int order = 0; order < MAX_ORDER; order++) {
+			_free_bitmaps[order] = metadata;
+			metadata += bitmap_words[order];
+		}
+
+		_prev = (uint32_t *)metadata;
+
+		// Hand each run of available pages to the free lists.  Everything else stays out
+		// of the free lists, and reserve_page() will accept it.
+		pfn_t pfn = _nr_pages;
+		while (pfn > 0) {
+			while (pfn > 0 && page_descriptors[pfn - 1].type != PageDescriptorType::AVAILABLE) {
+				pfn--;
+			}
+
+			pfn_t end = pfn;
+			while (pfn > 0 && page_descriptors[pfn - 1].type == PageDescriptorType::AVAILABLE) {
+				pfn--;
+			}
+
+			if (end > pfn) {
+				insert_range(pfn, end);
+			}
+		}
+
+		mm_log.messagef(LogLevel::DEBUG, "Buddy Allocator has %lu free pages", _nr_free_pages);
+
+		if (bench_iterations) {
+			run_benchmark(bench_iterations);
+		}
+
+		// The kernel runs its self-test (pgalloc.self-test) after init(), and then reserves
+		// every page that is not available, in address order from page zero.  The self-test
+		// itself reserves and frees pages in steps (7) to (9), so keep the page caches off
+		// until page zero is reserved.  Every page the self-test frees then goes straight
+		// back to the free lists, and its state dumps show the pages merging.
+		_caches_deferred = pcp_enabled;
+		pcp_enabled = false;
+
+		return true;
+	}
+
+	/**
+	 * Returns the friendly name of the allocation algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "buddy"; }
+
+	/**
+	 * Dumps out the current state of the buddy system
+	 */
+	void dump_state() const override
+	{
+		// Print out a header, so we can find the output in the logs.
+		mm_log.messagef(LogLevel::DEBUG, "BUDDY STATE: free=%lu, splits=%lu, merges=%lu", _nr_free_pages, _nr_splits, _nr_merges);
+		mm_log.messagef(LogLevel::DEBUG, "PAGE CACHES: cached=%lu, hits=%lu, refills=%lu, drains=%lu",
+						_nr_cached_pages, _nr_pcp_hits, _nr_pcp_refills, _nr_pcp_drains);
+
+		// Iterate over each free area.
+		for (unsigned int i = 0; i < ARRAY_SIZE(_free_areas); i++) {
+			char buffer[256];
+			int length = snprintf(buffer, sizeof(buffer), "[%d] ", i);
+
+			// Iterate over each block in the free area, until the buffer is full.
+			PageDescriptor *pg = _free_areas[i];
+			while (pg && length < (int)sizeof(buffer)) {
+				// Append the PFN of the free block to the output buffer.
+				length += snprintf(buffer + length, sizeof(buffer) - length, "%lx ", pfn_of(pg));
+				pg = pg->next_free;
+			}
+
+			mm_log.messagef(LogLevel::DEBUG, "%s", buffer);
+		}
+
+		// Then the blocks held in the page caches, hot end first.
+		for (unsigned int i = 0; i < ARRAY_SIZE(_caches); i++) {
+			char buffer[256];
+			int length = snprintf(buffer, sizeof(buffer), "PCP[%d] cached=%u%s: ", i, _caches[i].count, pcp_enabled ? "" : " (off)");
+
+			PageDescriptor *pg = _caches[i].head;
+			while (pg && length < (int)sizeof(buffer)) {
+				length += snprintf(buffer + length, sizeof(buffer) - length, "%lx ", pfn_of(pg));
+				pg = pg->next_free;
+			}
+
+			mm_log.messagef(LogLevel::DEBUG, "%s", buffer);
+		}
+	}
 
-/**
- * Returns the friendly name of the allocation algorithm, for debugging and selection purposes.
- */
-    const char *name() const override { return "buddy"; }
+private:
+	PageDescriptor *_page_descriptors;
+	uint64_t _nr_pages;
 
-/**
- * Dumps out the current state of the buddy system
- */
-    void dump_state()
+	PageDescriptor *_free_areas[MAX_ORDER];
+	uint64_t *_free_bitmaps[MAX_ORDER];
+	uint32_t *_prev;
+	uint32_t _nonempty_orders;
 
-    const override {
-// Print out a header, so we can find the output in the logs.
-        mm_log.
-                messagef(LogLevel::DEBUG,
-                         "BUDDY STATE:");
+	PageCache _caches[PCP_ORDERS];
+	bool _caches_deferred;
 
-// Iterate over each free area.
-        for (
-                unsigned int i = 0;
-                i < ARRAY_SIZE(_free_areas);
-                i++) {
-            char buffer[256];
-            snprintf(buffer,
-                     sizeof(buffer), "[%d] ", i);
+	uint64_t _nr_free_pages, _nr_cached_pages;
+	uint64_t _nr_splits, _nr_merges;
+	uint64_t _nr_pcp_hits, _nr_pcp_refills, _nr_pcp_drains;
 
-// Iterate over each block in the free area.
-            PageDescriptor *pg = _free_areas[i];
-            while (pg) {
-// Append the PFN of the free block to the output buffer.
-                snprintf(buffer,
-                         sizeof(buffer), "%s%lx ", buffer, sys.
+	static BuddyPageAllocator *instance;
+};
 
-                                        mm()
+BuddyPageAllocator *BuddyPageAllocator::instance;
 
-                                 .
+bool buddy::active()
+{
+	BuddyPageAllocator *alloc = BuddyPageAllocator::instance;
+	return alloc && sys.mm().pgalloc().algorithm() == alloc;
+}
 
-                                         pgalloc()
+PageDescriptor *buddy::alloc_pages_exact(uint64_t nr_pages)
+{
+	if (!active()) {
+		return NULL;
+	}
 
-                                 .
-                                         pgd_to_pfn(pg)
-                );
-                pg = pg->next_free;
-            }
+	UniqueIRQLock l;
 
-            mm_log.
-                    messagef(LogLevel::DEBUG,
-                             "%s", buffer);
-        }
-    }
+	PageDescriptor *pgd = BuddyPageAllocator::instance->alloc_pages_exact(nr_pages);
+	if (!pgd) {
+		return NULL;
+	}
 
+	// Mark the pages as allocated, as the page allocator does for the blocks it hands out.
+	for (uint64_t i = 0; i < nr_pages; i++) {
+		assert(pgd[i].type == PageDescriptorType::AVAILABLE);
+		pgd[i].type = PageDescriptorType::ALLOCATED;
+	}
 
-private:
-    PageDescriptor *_free_areas[MAX_ORDER];
-};
+	return pgd;
+}
+
+unsigned int buddy::alloc_pages_bulk(unsigned int nr_pages, PageDescriptor **pages)
+{
+	if (!active()) {
+		return 0;
+	}
+
+	UniqueIRQLock l;
+
+	unsigned int count = BuddyPageAllocator::instance->alloc_pages_bulk(nr_pages, pages);
+
+	for (unsigned int i = 0; i < count; i++) {
+		assert(pages[i]->type == PageDescriptorType::AVAILABLE);
+		pages[i]->type = PageDescriptorType::ALLOCATED;
+	}
+
+	return count;
+}
+
+void buddy::free_pages_exact(PageDescriptor *pgd, uint64_t nr_pages)
+{
+	assert(active());
+
+	UniqueIRQLock l;
+
+	BuddyPageAllocator::instance->free_pages_exact(pgd, nr_pages);
+
+	for (uint64_t i = 0; i < nr_pages; i++) {
+		assert(pgd[i].type == PageDescriptorType::ALLOCATED);
+		pgd[i].type = PageDescriptorType::AVAILABLE;
+	}
+}
 
 /* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
 
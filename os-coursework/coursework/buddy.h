@@ -0,0 +1,49 @@
+/*
+ * Buddy Page Allocation Algorithm Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef BUDDY_H
+#define BUDDY_H
+
+#include <infos/mm/page-allocator.h>
+
+namespace buddy {
+
+	/**
+	 * Returns TRUE if the "buddy" page allocation algorithm is in use, and so the functions
+	 * below can be called.
+	 */
+	extern bool active();
+
+	/**
+	 * Allocates exactly the given number of contiguous pages, rather than a whole
+	 * power-of-two block.  The range starts on a boundary of the next power of two pages,
+	 * and the pages past the end of the range stay free.
+	 * @param nr_pages The number of contiguous pages to allocate.
+	 * @return Returns the first page descriptor of the range, or NULL if no memory is
+	 * available or the "buddy" algorithm is not active.
+	 */
+	extern infos::mm::PageDescriptor *alloc_pages_exact(uint64_t nr_pages);
+
+	/**
+	 * Allocates a number of single pages, which need not be contiguous, in one pass under
+	 * one lock.  Each page is freed on its own, as an order-0 block.
+	 * @param nr_pages The number of pages to allocate.
+	 * @param pages The array that receives the page descriptors.
+	 * @return Returns the number of pages allocated, which is less than nr_pages only if
+	 * memory ran out, or zero if the "buddy" algorithm is not active.
+	 */
+	extern unsigned int alloc_pages_bulk(unsigned int nr_pages, infos::mm::PageDescriptor **pages);
+
+	/**
+	 * Frees a range of pages allocated with alloc_pages_exact().
+	 * @param pgd The first page descriptor of the range.
+	 * @param nr_pages The number of pages that were allocated.
+	 */
+	extern void free_pages_exact(infos::mm::PageDescriptor *pgd, uint64_t nr_pages);
+}
+
+#endif /* BUDDY_H */
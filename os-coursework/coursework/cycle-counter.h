@@ -0,0 +1,26 @@
+/*
+ * CPU Cycle Counter Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef CYCLE_COUNTER_H
+#define CYCLE_COUNTER_H
+
+#include <infos/define.h>
+
+/**
+ * Reads the CPU timestamp counter.  Unlike the kernel runtime, which moves in whole timer
+ * ticks, this can time intervals far shorter than a tick, and is available before any of
+ * the kernel's clock sources are.
+ */
+static inline uint64_t read_cycle_counter()
+{
+	uint32_t lo, hi;
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+
+	return ((uint64_t)hi << 32) | lo;
+}
+
+#endif /* CYCLE_COUNTER_H */
@@ -0,0 +1,377 @@
+/*
+ * Intrusive Red-Black Tree Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <infos/define.h>
+#include <infos/assert.h>
+
+namespace rbtree {
+
+	/**
+	 * The tree linkage embedded in an object.  An object can be a member of
+	 * more than one tree at a time, by embedding one link per tree.
+	 */
+	template<typename T>
+	struct RBLink {
+		RBLink() : Parent(NULL), Left(NULL), Right(NULL), Red(false) {
+		}
+
+		T *Parent;
+		T *Left, *Right;
+		bool Red;
+	};
+
+	/**
+	 * An intrusive red-black tree.  Nodes are never allocated by the tree -- the caller
+	 * owns the objects, and the tree only rewires the RBLink embedded in them.  This
+	 * is the same balancing scheme used by util::Map, but with removal, and with the
+	 * leftmost node cached so that the minimum is available in O(1).
+	 *
+	 * Compare must provide:
+	 *   static bool less(const T *l, const T *r);
+	 * and, to use find(), for each key type K:
+	 *   static int compare(const K& key, const T *node);
+	 */
+	template<typename T, RBLink<T> T::*Link, typename Compare>
+	class RBTree {
+	public:
+		RBTree() : _root(NULL), _leftmost(NULL), _count(0) {
+		}
+
+		T *root() const { return _root; }
+		T *leftmost() const { return _leftmost; }
+
+		unsigned int count() const { return _count; }
+		bool empty() const { return _count == 0; }
+
+		/**
+		 * Inserts a node into the tree.  Nodes that compare equal are inserted to the
+		 * right of the existing nodes, so equal keys are kept in FIFO order.
+		 * @param node The node to insert.  It must not already be in the tree.
+		 */
+		void insert(T *node) {
+			T *parent = NULL;
+			T **slot = &_root;
+			bool is_leftmost = true;
+
+			while (*slot) {
+				parent = *slot;
+
+				if (Compare::less(node, parent)) {
+					slot = &L(parent).Left;
+				} else {
+					slot = &L(parent).Right;
+					is_leftmost = false;
+				}
+			}
+
+			L(node).Parent = parent;
+			L(node).Left = NULL;
+			L(node).Right = NULL;
+			L(node).Red = true;
+			*slot = node;
+
+			if (is_leftmost) {
+				_leftmost = node;
+			}
+
+			_count++;
+			rebalance_insert(node);
+		}
+
+		/**
+		 * Removes a node from the tree.
+		 * @param node The node to remove.  It MUST be in the tree.
+		 */
+		void remove(T *node) {
+			assert(_count > 0);
+
+			if (node == _leftmost) {
+				_leftmost = next(node);
+			}
+
+			T *child, *parent;
+			bool removed_red;
+
+			if (!L(node).Left || !L(node).Right) {
+				// At most one child: splice the node out directly.
+				child = L(node).Left ? L(node).Left : L(node).Right;
+				parent = L(node).Parent;
+				removed_red = L(node).Red;
+
+				transplant(node, child);
+			} else {
+				// Two children: the in-order successor takes the node's place.
+				T *successor = L(node).Right;
+				while (L(successor).Left) {
+					successor = L(successor).Left;
+				}
+
+				child = L(successor).Right;
+				removed_red = L(successor).Red;
+
+				if (L(successor).Parent == node) {
+					parent = successor;
+				} else {
+					parent = L(successor).Parent;
+					transplant(successor, child);
+
+					L(successor).Right = L(node).Right;
+					L(L(successor).Right).Parent = successor;
+				}
+
+				transplant(node, successor);
+
+				L(successor).Left = L(node).Left;
+				L(L(successor).Left).Parent = successor;
+				L(successor).Red = L(node).Red;
+			}
+
+			L(node).Parent = NULL;
+			L(node).Left = NULL;
+			L(node).Right = NULL;
+
+			_count--;
+
+			if (!removed_red) {
+				rebalance_remove(child, parent);
+			}
+		}
+
+		/**
+		 * Looks up a node by key.
+		 * @param key The key to search for.
+		 * @return Returns the matching node, or NULL if there is no such node.
+		 */
+		template<typename TKey>
+		T *find(const TKey& key) const {
+			T *node = _root;
+
+			while (node) {
+				int c = Compare::compare(key, node);
+
+				if (c < 0) {
+					node = L(node).Left;
+				} else if (c > 0) {
+					node = L(node).Right;
+				} else {
+					return node;
+				}
+			}
+
+			return NULL;
+		}
+
+		/**
+		 * Returns the in-order successor of a node, or NULL if it is the last node.
+		 */
+		static T *next(T *node) {
+			if (L(node).Right) {
+				node = L(node).Right;
+				while (L(node).Left) {
+					node = L(node).Left;
+				}
+
+				return node;
+			}
+
+			T *parent = L(node).Parent;
+			while (parent && node == L(parent).Right) {
+				node = parent;
+				parent = L(node).Parent;
+			}
+
+			return parent;
+		}
+
+	private:
+		T *_root;
+		T *_leftmost;
+		unsigned int _count;
+
+		static inline RBLink<T>& L(T *node) {
+			return node->*Link;
+		}
+
+		static inline bool is_red(T *node) {
+			return node && L(node).Red;
+		}
+
+		/**
+		 * Replaces the subtree rooted at 'old_node' with the subtree rooted at 'new_node'.
+		 */
+		void transplant(T *old_node, T *new_node) {
+			T *parent = L(old_node).Parent;
+
+			if (!parent) {
+				_root = new_node;
+			} else if (L(parent).Left == old_node) {
+				L(parent).Left = new_node;
+			} else {
+				L(parent).Right = new_node;
+			}
+
+			if (new_node) {
+				L(new_node).Parent = parent;
+			}
+		}
+
+		void rotate_left(T *n) {
+			T *pivot = L(n).Right;
+			assert(pivot);
+
+			L(n).Right = L(pivot).Left;
+			if (L(pivot).Left) {
+				L(L(pivot).Left).Parent = n;
+			}
+
+			transplant(n, pivot);
+
+			L(pivot).Left = n;
+			L(n).Parent = pivot;
+		}
+
+		void rotate_right(T *n) {
+			T *pivot = L(n).Left;
+			assert(pivot);
+
+			L(n).Left = L(pivot).Right;
+			if (L(pivot).Right) {
+				L(L(pivot).Right).Parent = n;
+			}
+
+			transplant(n, pivot);
+
+			L(pivot).Right = n;
+			L(n).Parent = pivot;
+		}
+
+		void rebalance_insert(T *x) {
+			while (is_red(L(x).Parent)) {
+				T *parent = L(x).Parent;
+				T *grandparent = L(parent).Parent;
+
+				if (parent == L(grandparent).Left) {
+					T *uncle = L(grandparent).Right;
+
+					if (is_red(uncle)) {
+						L(parent).Red = false;
+						L(uncle).Red = false;
+						L(grandparent).Red = true;
+						x = grandparent;
+					} else {
+						if (x == L(parent).Right) {
+							x = parent;
+							rotate_left(x);
+							parent = L(x).Parent;
+						}
+
+						L(parent).Red = false;
+						L(grandparent).Red = true;
+						rotate_right(grandparent);
+					}
+				} else {
+					T *uncle = L(grandparent).Left;
+
+					if (is_red(uncle)) {
+						L(parent).Red = false;
+						L(uncle).Red = false;
+						L(grandparent).Red = true;
+						x = grandparent;
+					} else {
+						if (x == L(parent).Left) {
+							x = parent;
+							rotate_right(x);
+							parent = L(x).Parent;
+						}
+
+						L(parent).Red = false;
+						L(grandparent).Red = true;
+						rotate_left(grandparent);
+					}
+				}
+			}
+
+			L(_root).Red = false;
+		}
+
+		/**
+		 * Restores the red-black properties after a black node has been removed.
+		 * @param x The node that replaced the removed node (may be NULL).
+		 * @param parent The parent of x.
+		 */
+		void rebalance_remove(T *x, T *parent) {
+			while (x != _root && !is_red(x)) {
+				if (x == L(parent).Left) {
+					T *sibling = L(parent).Right;
+
+					if (is_red(sibling)) {
+						L(sibling).Red = false;
+						L(parent).Red = true;
+						rotate_left(parent);
+						sibling = L(parent).Right;
+					}
+
+					if (!is_red(L(sibling).Left) && !is_red(L(sibling).Right)) {
+						L(sibling).Red = true;
+						x = parent;
+						parent = L(x).Parent;
+					} else {
+						if (!is_red(L(sibling).Right)) {
+							L(L(sibling).Left).Red = false;
+							L(sibling).Red = true;
+							rotate_right(sibling);
+							sibling = L(parent).Right;
+						}
+
+						L(sibling).Red = L(parent).Red;
+						L(parent).Red = false;
+						L(L(sibling).Right).Red = false;
+						rotate_left(parent);
+						x = _root;
+					}
+				} else {
+					T *sibling = L(parent).Left;
+
+					if (is_red(sibling)) {
+						L(sibling).Red = false;
+						L(parent).Red = true;
+						rotate_right(parent);
+						sibling = L(parent).Left;
+					}
+
+					if (!is_red(L(sibling).Left) && !is_red(L(sibling).Right)) {
+						L(sibling).Red = true;
+						x = parent;
+						parent = L(x).Parent;
+					} else {
+						if (!is_red(L(sibling).Left)) {
+							L(L(sibling).Right).Red = false;
+							L(sibling).Red = true;
+							rotate_left(sibling);
+							sibling = L(parent).Left;
+						}
+
+						L(sibling).Red = L(parent).Red;
+						L(parent).Red = false;
+						L(L(sibling).Left).Red = false;
+						rotate_right(parent);
+						x = _root;
+					}
+				}
+			}
+
+			if (x) {
+				L(x).Red = false;
+			}
+		}
+	};
+}
+
+#endif /* RBTREE_H */
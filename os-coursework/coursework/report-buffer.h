@@ -0,0 +1,99 @@
+/*
+ * Report Buffer Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef REPORT_BUFFER_H
+#define REPORT_BUFFER_H
+
+#include <infos/kernel/kernel.h>
+#include <infos/mm/mm.h>
+#include <infos/mm/object-allocator.h>
+#include <infos/fs/file.h>
+#include <infos/util/printf.h>
+#include <infos/util/string.h>
+
+/**
+ * A text buffer that output is appended to, for building the reports served by the
+ * statistics devices.
+ */
+class ReportBuffer
+{
+public:
+	ReportBuffer(size_t size) : _buffer((char *)infos::kernel::sys.mm().objalloc().alloc(size)), _size(size), _length(0) { }
+	~ReportBuffer() { infos::kernel::sys.mm().objalloc().free(_buffer); }
+
+	void appendf(const char *fmt, ...)
+	{
+		va_list args;
+
+		va_start(args, fmt);
+		_length += infos::util::vsnprintf(_buffer + _length, _size - _length, fmt, args);
+		va_end(args);
+	}
+
+	const char *data() const { return _buffer; }
+	size_t length() const { return _length; }
+
+private:
+	char *_buffer;
+	size_t _size;
+	size_t _length;
+};
+
+/**
+ * An open file serving a report.  The report is built when the file is opened, so that
+ * reads see a consistent snapshot.  Writes are ignored, unless a subclass handles them.
+ */
+class ReportFile : public infos::fs::File
+{
+public:
+	ReportFile(size_t size) : _report(size), _pos(0) { }
+
+	void close() override
+	{
+	}
+
+	int pread(void* buffer, size_t size, off_t off) override
+	{
+		if ((size_t)off >= _report.length()) return 0;
+
+		size_t n = _report.length() - off;
+		if (n > size) n = size;
+
+		infos::util::memcpy(buffer, _report.data() + off, n);
+		return n;
+	}
+
+	int read(void* buffer, size_t size) override
+	{
+		int n = pread(buffer, size, _pos);
+		_pos += n;
+
+		return n;
+	}
+
+	void seek(off_t offset, SeekType type) override
+	{
+		if (type == SeekAbsolute) {
+			_pos = offset;
+		} else {
+			_pos += offset;
+		}
+	}
+
+	int write(const void* buffer, size_t size) override
+	{
+		return 0;
+	}
+
+protected:
+	ReportBuffer _report;
+
+private:
+	off_t _pos;
+};
+
+#endif /* REPORT_BUFFER_H */
@@ -0,0 +1,14 @@
+/*
+ * Red-Black Tree Completely Fair Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#include "sched-cfs-rb.h"
+
+RegisterObjectCache(FairEntity, "cfs-rb-entity");
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(RBCompletelyFairScheduler);
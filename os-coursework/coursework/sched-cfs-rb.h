@@ -0,0 +1,229 @@
+/*
+ * Red-Black Tree Completely Fair Scheduling Algorithm Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef SCHED_CFS_RB_H
+#define SCHED_CFS_RB_H
+
+#include "rbtree.h"
+#include "sched-common.h"
+#include "sched-class.h"
+#include "sched-stats.h"
+#include "slab.h"
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+/**
+ * The load weight of an entity at the default priority.  Virtual runtime advances at
+ * the same rate as real time for an entity of this weight.
+ */
+#define NICE_0_WEIGHT	1024
+
+/**
+ * Scheduler-private state for a scheduling entity.
+ */
+struct FairEntity {
+	FairEntity(infos::kernel::SchedulingEntity& entity) : entity(entity), vruntime(0), weight(NICE_0_WEIGHT), queued(false) {
+	}
+
+	SlabAllocated;
+
+	infos::kernel::SchedulingEntity& entity;
+
+	// The weighted virtual runtime (in nanoseconds) -- the key of the timeline.
+	uint64_t vruntime;
+	uint64_t weight;
+	bool queued;
+
+	// Link into the runqueue timeline, ordered by virtual runtime.
+	rbtree::RBLink<FairEntity> timeline_link;
+
+	// Link into the entity index, ordered by the address of the scheduling entity.
+	rbtree::RBLink<FairEntity> index_link;
+};
+
+struct FairTimelineOrder {
+	static bool less(const FairEntity *l, const FairEntity *r) {
+		return l->vruntime < r->vruntime;
+	}
+};
+
+/**
+ * A completely fair scheduling algorithm, with the runqueue kept in a red-black
+ * tree ordered by weighted virtual runtime.
+ */
+class RBCompletelyFairScheduler : public SchedulingClass
+{
+public:
+	/**
+	 * Constructs a new instance of the fair scheduler.
+	 * @param record_stats TRUE if this instance is driven directly by the Scheduler, and
+	 * should report to sched_stats.  Instances embedded in another algorithm leave that
+	 * to the algorithm that embeds them.
+	 */
+	RBCompletelyFairScheduler(bool record_stats = true) : _record_stats(record_stats), _current(NULL), _current_start(0), _min_vruntime(0) { }
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "cfs-rb"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(infos::kernel::SchedulingEntity& entity) override
+	{
+		infos::util::UniqueIRQLock l;
+
+		FairEntity *fe = _index.lookup(entity);
+		if (fe->queued) return;
+
+		// Place the entity no earlier than the minimum virtual runtime, so that a new
+		// (or long-sleeping) entity cannot monopolise the CPU until it catches up.
+		if (fe->vruntime < _min_vruntime) {
+			fe->vruntime = _min_vruntime;
+		}
+
+		_timeline.insert(fe);
+		fe->queued = true;
+
+		if (_record_stats) {
+			sched_stats::entity_woken(entity);
+		}
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(infos::kernel::SchedulingEntity& entity) override
+	{
+		infos::util::UniqueIRQLock l;
+
+		FairEntity *fe = _index.find(entity);
+		if (!fe || !fe->queued) return;
+
+		_timeline.remove(fe);
+		fe->queued = false;
+
+		if (fe == _current) {
+			charge(fe, sched_common::now());
+			_current = NULL;
+		}
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  The next eligible entity might actually be the same entity, if
+	 * e.g. its timeslice has not expired.
+	 */
+	infos::kernel::SchedulingEntity *pick_next_entity() override
+	{
+		uint64_t ts = sched_common::now();
+
+		// Only the entity that has been running can have moved in the timeline, so
+		// re-key that one entity, and the leftmost node is then the next to run.
+		if (_current) {
+			_timeline.remove(_current);
+			charge(_current, ts);
+			_timeline.insert(_current);
+		}
+
+		FairEntity *next = _timeline.leftmost();
+
+		if (_record_stats) {
+			sched_stats::entity_picked(next ? &next->entity : NULL, _timeline.count());
+		}
+
+		if (!next) {
+			_current = NULL;
+			return NULL;
+		}
+
+		// The minimum virtual runtime only ever moves forwards.
+		if (next->vruntime > _min_vruntime) {
+			_min_vruntime = next->vruntime;
+		}
+
+		_current = next;
+		_current_start = ts;
+
+		return &next->entity;
+	}
+
+	/**
+	 * Called when the running entity has been preempted by a higher scheduling class.
+	 */
+	void put_prev_entity() override
+	{
+		if (_current) {
+			_timeline.remove(_current);
+			charge(_current, sched_common::now());
+			_timeline.insert(_current);
+
+			_current = NULL;
+		}
+	}
+
+	/**
+	 * Sets the load weight of an entity.  Heavier entities accumulate virtual runtime
+	 * more slowly, and so receive a proportionally larger share of the CPU.
+	 * @param entity The entity to change.
+	 * @param weight The new weight, where NICE_0_WEIGHT is the default.
+	 */
+	void set_weight(infos::kernel::SchedulingEntity& entity, uint64_t weight)
+	{
+		infos::util::UniqueIRQLock l;
+
+		FairEntity *fe = _index.lookup(entity);
+
+		// Charge the running entity at its old weight before changing it.  The key
+		// itself does not change, so the entity keeps its place in the timeline.
+		if (fe == _current) {
+			_timeline.remove(fe);
+			charge(fe, sched_common::now());
+			_timeline.insert(fe);
+		}
+
+		fe->weight = weight;
+	}
+
+	/**
+	 * Returns the number of runnable entities.
+	 */
+	unsigned int nr_running() const { return _timeline.count(); }
+
+private:
+	bool _record_stats;
+
+	// The runqueue, ordered by virtual runtime.
+	rbtree::RBTree<FairEntity, &FairEntity::timeline_link, FairTimelineOrder> _timeline;
+
+	// Every entity this scheduler has seen, ordered by entity address.  Records are
+	// kept while an entity sleeps, so that it retains its virtual runtime.
+	sched_common::EntityIndex<FairEntity> _index;
+
+	FairEntity *_current;
+	uint64_t _current_start;
+	uint64_t _min_vruntime;
+
+	/**
+	 * Charges an entity for the time it has been running since it was last picked.
+	 * The entity must not be in the timeline while its key is changed.
+	 */
+	void charge(FairEntity *fe, uint64_t ts)
+	{
+		uint64_t delta = ts - _current_start;
+		fe->vruntime += (delta * NICE_0_WEIGHT) / fe->weight;
+		_current_start = ts;
+	}
+};
+
+#endif /* SCHED_CFS_RB_H */
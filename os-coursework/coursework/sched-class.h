@@ -0,0 +1,28 @@
+/*
+ * Scheduling Class Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef SCHED_CLASS_H
+#define SCHED_CLASS_H
+
+#include <infos/kernel/sched.h>
+
+/**
+ * A scheduling algorithm that can be stacked underneath higher-priority algorithms.
+ * When a higher-priority class takes the CPU away, the class that was running is
+ * told, so that it can stop charging time to the entity it last picked.
+ */
+class SchedulingClass : public infos::kernel::SchedulingAlgorithm
+{
+public:
+	/**
+	 * Called when the entity most recently picked by this class has been preempted
+	 * by an entity from a higher-priority class.
+	 */
+	virtual void put_prev_entity() = 0;
+};
+
+#endif /* SCHED_CLASS_H */
@@ -0,0 +1,112 @@
+/*
+ * Common Scheduling Algorithm Helpers
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#include "sched-common.h"
+#include <infos/kernel/thread.h>
+#include <infos/kernel/process.h>
+#include <infos/util/string.h>
+
+using namespace infos::kernel;
+using namespace infos::util;
+
+/**
+ * Returns TRUE if a name is exactly the 'length' characters at 'key'.
+ */
+static bool name_matches(const char *name, const char *key, size_t length)
+{
+	return strlen(name) == length && strncmp(name, key, length) == 0;
+}
+
+const char *sched_common::find_entity_rule(const char *rules, SchedulingEntity& entity)
+{
+	const char *name = static_cast<Thread&>(entity).owner().name().c_str();
+
+	const char *base = name;
+	for (const char *p = name; *p; p++) {
+		if (*p == '/') {
+			base = p + 1;
+		}
+	}
+
+	const char *rule = rules;
+	while (*rule) {
+		const char *end = rule;
+		while (*end && *end != ':' && *end != ',') {
+			end++;
+		}
+
+		size_t length = end - rule;
+		if (*end == ':' && length > 0 && (name_matches(name, rule, length) || name_matches(base, rule, length))) {
+			return end + 1;
+		}
+
+		// Move on to the next rule.
+		while (*end && *end != ',') {
+			end++;
+		}
+
+		rule = *end ? end + 1 : end;
+	}
+
+	return NULL;
+}
+
+bool sched_common::next_rule_field(const char *&cursor, char *field, size_t size)
+{
+	if (!*cursor || *cursor == ',') {
+		return false;
+	}
+
+	size_t length = 0;
+	while (*cursor && *cursor != ':' && *cursor != ',') {
+		if (length < size - 1) {
+			field[length++] = *cursor;
+		}
+
+		cursor++;
+	}
+
+	field[length] = 0;
+
+	if (*cursor == ':') {
+		cursor++;
+	}
+
+	return true;
+}
+
+bool sched_common::parse_decimal(const char *str, int64_t& value)
+{
+	bool negative = (*str == '-');
+	if (negative) {
+		str++;
+	}
+
+	if (*str < '0' || *str > '9') {
+		return false;
+	}
+
+	// Values that do not fit are rejected, rather than wrapping around.
+	const int64_t max = (int64_t)(~0ull >> 1);
+
+	value = 0;
+	while (*str >= '0' && *str <= '9') {
+		int digit = *str++ - '0';
+
+		if (value > (max - digit) / 10) {
+			return false;
+		}
+
+		value = (value * 10) + digit;
+	}
+
+	if (negative) {
+		value = -value;
+	}
+
+	return *str == 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Common Scheduling Algorithm Helpers Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef SCHED_COMMON_H
+#define SCHED_COMMON_H
+
+#include "rbtree.h"
+#include <infos/kernel/sched-entity.h>
+#include <infos/kernel/kernel.h>
+
+namespace sched_common {
+
+	/**
+	 * Returns the current kernel runtime, in nanoseconds.  This is read as a raw count,
+	 * as Timepoint subtraction in util/time.h has its operands reversed.  The runtime
+	 * only moves on when the timer ticks.
+	 */
+	static inline uint64_t now()
+	{
+		return infos::kernel::sys.runtime().time_since_epoch().count();
+	}
+
+	/**
+	 * An index of the private records a scheduling algorithm keeps for each entity it
+	 * has seen, ordered by the address of the scheduling entity.  T must have a
+	 * constructor taking the SchedulingEntity, a reference to it named 'entity', and an
+	 * RBLink<T> named 'index_link'.
+	 */
+	template<typename T>
+	class EntityIndex {
+	public:
+		/**
+		 * Returns the record for an entity, or NULL if the entity has not been seen.
+		 */
+		T *find(infos::kernel::SchedulingEntity& entity) const {
+			return _tree.find(&entity);
+		}
+
+		/**
+		 * Creates the record for an entity that has not been seen before.
+		 */
+		T *create(infos::kernel::SchedulingEntity& entity) {
+			T *record = new T(entity);
+			_tree.insert(record);
+
+			return record;
+		}
+
+		/**
+		 * Returns the record for an entity, creating it if the entity has not been seen.
+		 */
+		T *lookup(infos::kernel::SchedulingEntity& entity) {
+			T *record = find(entity);
+			return record ? record : create(entity);
+		}
+
+		T *first() const { return _tree.leftmost(); }
+		static T *next(T *record) { return Tree::next(record); }
+
+		unsigned int count() const { return _tree.count(); }
+
+	private:
+		struct Order {
+			static bool less(const T *l, const T *r) {
+				return &l->entity < &r->entity;
+			}
+
+			static int compare(const infos::kernel::SchedulingEntity *key, const T *node) {
+				if (key < &node->entity) return -1;
+				if (key > &node->entity) return 1;
+				return 0;
+			}
+		};
+
+		typedef rbtree::RBTree<T, &T::index_link, Order> Tree;
+		Tree _tree;
+	};
+
+	/**
+	 * Finds the rule for an entity in a list of rules given on the command line.  Rules are
+	 * separated by ',' and have the form name:field[:field...], where name is the name of
+	 * the process that owns the entity, either in full or from after its last '/'.
+	 * @param rules The list of rules.
+	 * @param entity The entity, which must be a thread.
+	 * @return Returns the fields of the matching rule, or NULL if no rule matches.
+	 */
+	extern const char *find_entity_rule(const char *rules, infos::kernel::SchedulingEntity& entity);
+
+	/**
+	 * Copies the next field of a rule into 'field', and moves 'cursor' past it.
+	 * @return Returns FALSE if the rule has no more fields.
+	 */
+	extern bool next_rule_field(const char *&cursor, char *field, size_t size);
+
+	/**
+	 * Parses a decimal integer, with an optional leading '-'.
+	 * @return Returns FALSE if the string is not a decimal integer, or does not fit in an
+	 * int64_t.
+	 */
+	extern bool parse_decimal(const char *str, int64_t& value);
+}
+
+#endif /* SCHED_COMMON_H */
@@ -0,0 +1,585 @@
+/*
+ * Earliest-Deadline-First Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#include "sched-edf.h"
+#include "sched-cfs-rb.h"
+#include "sched-stats.h"
+#include "rbtree.h"
+#include "sched-common.h"
+#include "slab.h"
+#include <infos/kernel/sched.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+#include <infos/util/string.h>
+#include <infos/util/cmdline.h>
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace rbtree;
+using namespace sched_common;
+using namespace sched_edf;
+
+/**
+ * Utilisation is tracked as a fixed-point fraction, where (1 << BW_SHIFT) is 100%.
+ */
+#define BW_SHIFT	20
+#define BW_UNIT		(1ULL << BW_SHIFT)
+
+/**
+ * Reservations for entities, given on the command line as rules of the form
+ * name:runtime:deadline:period, in milliseconds, e.g. "sched.edf=player:10:20:40".  A rule
+ * is applied when the scheduler first sees an entity of the named process, and is subject
+ * to the same admission control as set_entity_reservation().
+ */
+static char reservation_rules[64];
+static bool do_self_test;
+
+RegisterCmdLineArgument(SchedEDF, "sched.edf") {
+	strncpy(reservation_rules, value, sizeof(reservation_rules) - 1);
+}
+
+RegisterCmdLineArgument(SchedEDFSelfTest, "sched.edf-self-test") {
+	do_self_test = (strncmp(value, "1", 2) == 0);
+}
+
+/**
+ * Parses the fields of a reservation rule.
+ * @param fields The fields, following the process name.
+ * @param runtime, deadline, period Receive the reservation, in nanoseconds.
+ * @return Returns FALSE if the rule is malformed.
+ */
+static bool parse_reservation_rule(const char *fields, uint64_t& runtime, uint64_t& deadline, uint64_t& period)
+{
+	uint64_t *values[] = { &runtime, &deadline, &period };
+	char field[16];
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(values); i++) {
+		int64_t ms;
+
+		if (!next_rule_field(fields, field, sizeof(field)) || !parse_decimal(field, ms) || ms <= 0) {
+			return false;
+		}
+
+		*values[i] = (uint64_t)ms * 1000000;
+	}
+
+	return true;
+}
+
+namespace EDFEntityState
+{
+	enum EDFEntityState
+	{
+		IDLE,			// Not runnable.
+		READY,			// Runnable, with budget left in the current period.
+		THROTTLED,		// Runnable, but out of budget until the next period.
+	};
+}
+
+/**
+ * Scheduler-private state for a scheduling entity.
+ */
+struct EDFEntity {
+	EDFEntity(SchedulingEntity& entity) : entity(entity), state(EDFEntityState::IDLE), reserved(false), queued(false),
+		runtime(0), deadline(0), period(0), period_start(0), abs_deadline(0), budget(0), misses(0) {
+	}
+
+	SlabAllocated;
+
+	SchedulingEntity& entity;
+
+	EDFEntityState::EDFEntityState state;
+	bool reserved;
+	bool queued;
+
+	// The reservation parameters, in nanoseconds.
+	uint64_t runtime, deadline, period;
+
+	// The current period: when it started, its absolute deadline, and the remaining budget.
+	uint64_t period_start;
+	uint64_t abs_deadline;
+	uint64_t budget;
+
+	unsigned long misses;
+
+	// Link into the ready queue (ordered by absolute deadline), or into the throttled
+	// queue (ordered by the start of the next period).
+	RBLink<EDFEntity> queue_link;
+
+	// Link into the entity index, ordered by the address of the scheduling entity.
+	RBLink<EDFEntity> index_link;
+
+	uint64_t next_period_start() const { return period_start + period; }
+	uint64_t bandwidth() const { return (runtime << BW_SHIFT) / period; }
+};
+
+RegisterObjectCache(EDFEntity, "edf-entity");
+
+struct EDFDeadlineOrder {
+	static bool less(const EDFEntity *l, const EDFEntity *r) {
+		return l->abs_deadline < r->abs_deadline;
+	}
+};
+
+struct EDFReleaseOrder {
+	static bool less(const EDFEntity *l, const EDFEntity *r) {
+		return l->next_period_start() < r->next_period_start();
+	}
+};
+
+/**
+ * An earliest-deadline-first scheduling algorithm.  Entities with a reservation run in
+ * order of absolute deadline, and are throttled once they have used their runtime for
+ * the current period, so that a misbehaving entity cannot eat into the reservations of
+ * others.  Admission control keeps the total reserved utilisation at or below 100%.
+ * Entities without a reservation are scheduled by the completely fair scheduler, in
+ * whatever time the reserved entities leave.
+ */
+class EarliestDeadlineFirstScheduler : public SchedulingAlgorithm
+{
+	friend bool sched_edf::set_entity_reservation(SchedulingEntity&, uint64_t, uint64_t, uint64_t);
+	friend unsigned long sched_edf::entity_deadline_misses(SchedulingEntity&);
+
+public:
+	/**
+	 * Constructs a new instance of the algorithm.
+	 * @param registered TRUE if this instance is driven directly by the Scheduler.  Other
+	 * instances, such as the self-test's, neither report to sched_stats nor apply the
+	 * reservation rules from the command line, and run on the self-test's clock.
+	 */
+	EarliestDeadlineFirstScheduler(bool registered = true) : _background(false), _current(NULL), _current_start(0), _background_active(false),
+		_total_bw(0), _registered(registered)
+	{
+		if (registered) {
+			instance = this;
+		}
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "edf"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		// The self-test needs the memory manager, which is up by the time the first
+		// entity (the idle thread) is added.
+		if (_registered && do_self_test) {
+			do_self_test = false;
+
+			if (!self_test()) {
+				sched_log.message(LogLevel::FATAL, "EDF scheduler self-test failed!");
+				arch_abort();
+			}
+		}
+
+		EDFEntity *ee = _index.find(entity);
+		if (!ee) {
+			ee = _index.create(entity);
+
+			if (_registered) {
+				apply_reservation_rule(entity);
+			}
+		}
+
+		if (ee->queued) return;
+
+		enqueue(ee);
+
+		if (_registered) {
+			sched_stats::entity_woken(entity);
+		}
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		EDFEntity *ee = _index.find(entity);
+		if (!ee || !ee->queued) return;
+
+		ee->queued = false;
+
+		if (ee->reserved) {
+			if (ee == _current) {
+				charge(now());
+				_current = NULL;
+			}
+
+			dequeue_reserved(ee);
+		} else {
+			_background.remove_from_runqueue(entity);
+		}
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		uint64_t ts = now();
+
+		if (_current) {
+			charge(ts);
+		}
+
+		// Start the next period for throttled entities whose period has come round.
+		while (!_throttled.empty() && _throttled.leftmost()->next_period_start() <= ts) {
+			EDFEntity *ee = _throttled.leftmost();
+			_throttled.remove(ee);
+
+			replenish(ee, ee->next_period_start());
+			ee->state = EDFEntityState::READY;
+			_ready.insert(ee);
+		}
+
+		// Any ready entity whose deadline has passed did not get its runtime in time.
+		// Count the miss, and move it on to a fresh period.
+		while (!_ready.empty() && _ready.leftmost()->abs_deadline <= ts) {
+			EDFEntity *ee = _ready.leftmost();
+			_ready.remove(ee);
+
+			ee->misses++;
+			sched_log.messagef(LogLevel::DEBUG, "EDF: %p missed deadline (%lu misses)", &ee->entity, ee->misses);
+
+			replenish(ee, ts);
+			_ready.insert(ee);
+		}
+
+		EDFEntity *next = _ready.leftmost();
+
+		if (next) {
+			if (_background_active) {
+				_background.put_prev_entity();
+				_background_active = false;
+			}
+
+			if (next != _current) {
+				_current = next;
+				_current_start = ts;
+			}
+
+			if (_registered) {
+				sched_stats::entity_picked(&next->entity, nr_running());
+			}
+
+			return &next->entity;
+		}
+
+		_current = NULL;
+
+		SchedulingEntity *background = _background.pick_next_entity();
+		_background_active = (background != NULL);
+
+		if (_registered) {
+			sched_stats::entity_picked(background, nr_running());
+		}
+
+		return background;
+	}
+
+	static EarliestDeadlineFirstScheduler *instance;
+
+private:
+	// Ready entities with a reservation, ordered by absolute deadline.
+	RBTree<EDFEntity, &EDFEntity::queue_link, EDFDeadlineOrder> _ready;
+
+	// Runnable entities that have used their budget, ordered by the start of their next period.
+	RBTree<EDFEntity, &EDFEntity::queue_link, EDFReleaseOrder> _throttled;
+
+	// Every entity this scheduler has seen, ordered by entity address.
+	EntityIndex<EDFEntity> _index;
+
+	// The scheduler for entities without a reservation.
+	RBCompletelyFairScheduler _background;
+
+	EDFEntity *_current;
+	uint64_t _current_start;
+	bool _background_active;
+
+	// The sum of the bandwidths of all reservations.
+	uint64_t _total_bw;
+
+	bool _registered;
+
+	// The time, in nanoseconds, on the clock the self-test's instance runs on.
+	static uint64_t self_test_clock;
+
+	/**
+	 * Returns the current time, in nanoseconds.
+	 */
+	uint64_t now() const
+	{
+		return _registered ? sched_common::now() : self_test_clock;
+	}
+
+	/**
+	 * Returns the number of runnable entities, including throttled ones.
+	 */
+	unsigned int nr_running() const
+	{
+		return _ready.count() + _throttled.count() + _background.nr_running();
+	}
+
+	/**
+	 * Starts a new period for an entity.
+	 */
+	static void replenish(EDFEntity *ee, uint64_t period_start)
+	{
+		ee->period_start = period_start;
+		ee->abs_deadline = period_start + ee->deadline;
+		ee->budget = ee->runtime;
+	}
+
+	/**
+	 * Charges the running reserved entity, and throttles it if it has used its budget.
+	 */
+	void charge(uint64_t ts)
+	{
+		uint64_t delta = ts - _current_start;
+		_current_start = ts;
+
+		if (delta < _current->budget) {
+			_current->budget -= delta;
+			return;
+		}
+
+		_current->budget = 0;
+
+		if (_current->state == EDFEntityState::READY) {
+			_ready.remove(_current);
+			_current->state = EDFEntityState::THROTTLED;
+			_throttled.insert(_current);
+		}
+	}
+
+	/**
+	 * Queues an entity that is not queued, in the reserved queue or the background class.
+	 * This does not count as a wakeup for sched_stats.
+	 */
+	void enqueue(EDFEntity *ee)
+	{
+		ee->queued = true;
+
+		if (ee->reserved) {
+			wake_reserved(ee, now());
+		} else {
+			_background.add_to_runqueue(ee->entity);
+		}
+	}
+
+	/**
+	 * Makes a reserved entity runnable.  An entity that wakes within its current period
+	 * keeps its remaining budget and deadline, so that sleeping cannot be used to gain
+	 * extra runtime.  Otherwise, a new period starts now.
+	 */
+	void wake_reserved(EDFEntity *ee, uint64_t ts)
+	{
+		if (ts >= ee->abs_deadline) {
+			replenish(ee, ts);
+		}
+
+		if (ee->budget > 0) {
+			ee->state = EDFEntityState::READY;
+			_ready.insert(ee);
+		} else {
+			ee->state = EDFEntityState::THROTTLED;
+			_throttled.insert(ee);
+		}
+	}
+
+	void dequeue_reserved(EDFEntity *ee)
+	{
+		if (ee->state == EDFEntityState::READY) {
+			_ready.remove(ee);
+		} else if (ee->state == EDFEntityState::THROTTLED) {
+			_throttled.remove(ee);
+		}
+
+		ee->state = EDFEntityState::IDLE;
+	}
+
+	bool set_reservation(SchedulingEntity& entity, uint64_t runtime, uint64_t deadline, uint64_t period)
+	{
+		if (runtime > 0 && (runtime > deadline || deadline > period)) {
+			return false;
+		}
+
+		UniqueIRQLock l;
+
+		EDFEntity *ee = _index.lookup(entity);
+
+		uint64_t old_bw = ee->reserved ? ee->bandwidth() : 0;
+		uint64_t new_bw = runtime > 0 ? (runtime << BW_SHIFT) / period : 0;
+
+		// Admission control: refuse anything that would over-commit the CPU.
+		if (_total_bw - old_bw + new_bw > BW_UNIT) {
+			sched_log.messagef(LogLevel::DEBUG, "EDF: rejected reservation for %p", &entity);
+			return false;
+		}
+
+		// Take the entity out of whichever queue it is in while it changes.
+		bool was_queued = ee->queued;
+		if (was_queued) {
+			remove_from_runqueue(entity);
+		}
+
+		_total_bw = _total_bw - old_bw + new_bw;
+
+		ee->reserved = (runtime > 0);
+		ee->runtime = runtime;
+		ee->deadline = deadline;
+		ee->period = period;
+		ee->abs_deadline = 0;
+		ee->budget = 0;
+		ee->misses = 0;
+
+		if (was_queued) {
+			enqueue(ee);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Applies the reservation rule for the process an entity belongs to, if there is one.
+	 */
+	void apply_reservation_rule(SchedulingEntity& entity)
+	{
+		if (!reservation_rules[0]) return;
+
+		const char *fields = find_entity_rule(reservation_rules, entity);
+		if (!fields) return;
+
+		uint64_t runtime, deadline, period;
+
+		if (!parse_reservation_rule(fields, runtime, deadline, period) || !set_reservation(entity, runtime, deadline, period)) {
+			sched_log.messagef(LogLevel::WARNING, "Invalid or rejected EDF reservation rule for entity %p", &entity);
+		}
+	}
+
+	/**
+	 * A scheduling entity that is only ever queued and picked, for the self-test.
+	 */
+	struct TestEntity : public SchedulingEntity {
+		bool activate(SchedulingEntity *prev) override { return false; }
+	};
+
+	static bool expect(bool condition, const char *what)
+	{
+		if (!condition) {
+			sched_log.messagef(LogLevel::ERROR, "Self-test check failed: %s", what);
+		}
+
+		return condition;
+	}
+
+	static uint64_t ms(uint64_t value) { return value * 1000000; }
+
+	/**
+	 * Checks the rule parser, admission control, deadline ordering, budget throttling and
+	 * deadline-miss accounting on a private instance of the algorithm, moving its clock by
+	 * hand.  The test instance's records are not reclaimed, as the algorithm never frees
+	 * records.
+	 * @return Returns TRUE if every check passed.
+	 */
+	static bool self_test()
+	{
+		sched_log.message(LogLevel::IMPORTANT, "EDF SCHEDULER SELF TEST - BEGIN");
+
+		uint64_t runtime, deadline, period;
+
+		sched_log.message(LogLevel::INFO, "(1) PARSING RESERVATION RULES");
+		if (!expect(parse_reservation_rule("10:20:40", runtime, deadline, period) && runtime == ms(10) && deadline == ms(20) && period == ms(40), "10:20:40")) return false;
+		if (!expect(parse_reservation_rule("5:5:5,other:1:1:1", runtime, deadline, period) && runtime == ms(5) && period == ms(5), "5:5:5")) return false;
+		if (!expect(!parse_reservation_rule("10:20", runtime, deadline, period), "missing period is rejected")) return false;
+		if (!expect(!parse_reservation_rule("0:20:40", runtime, deadline, period), "zero runtime is rejected")) return false;
+
+		EarliestDeadlineFirstScheduler edf(false);
+		TestEntity a, b, c, background;
+
+		sched_log.message(LogLevel::INFO, "(2) ADMISSION CONTROL");
+		if (!expect(!edf.set_reservation(a, ms(30), ms(20), ms(100)), "runtime past the deadline is rejected")) return false;
+		if (!expect(edf.set_reservation(a, ms(10), ms(50), ms(100)), "a: 10% accepted")) return false;
+		if (!expect(edf.set_reservation(b, ms(10), ms(20), ms(100)), "b: 10% accepted")) return false;
+		if (!expect(!edf.set_reservation(c, ms(90), ms(100), ms(100)), "c: 90% rejected, for 110% in all")) return false;
+		if (!expect(edf.set_reservation(c, ms(80), ms(100), ms(100)), "c: 80% accepted, for 100% in all")) return false;
+		if (!expect(edf.set_reservation(c, 0, 0, 0), "c: reservation removed")) return false;
+
+		sched_log.message(LogLevel::INFO, "(3) RESERVED ENTITIES RUN BY DEADLINE, BEFORE THE REST");
+		self_test_clock = ms(1000);
+		edf.add_to_runqueue(background);
+		if (!expect(edf.pick_next_entity() == &background, "background runs alone")) return false;
+		edf.add_to_runqueue(a);
+		edf.add_to_runqueue(b);
+		if (!expect(edf.pick_next_entity() == &b, "b (deadline 20ms) runs first")) return false;
+		edf.remove_from_runqueue(b);
+		if (!expect(edf.pick_next_entity() == &a, "a (deadline 50ms) runs next")) return false;
+
+		sched_log.message(LogLevel::INFO, "(4) BUDGET THROTTLING");
+		self_test_clock += ms(10);
+		if (!expect(edf.pick_next_entity() == &background, "a is throttled after its 10ms runtime")) return false;
+		self_test_clock += ms(50);
+		if (!expect(edf.pick_next_entity() == &background, "a stays throttled until its next period")) return false;
+		self_test_clock += ms(40);
+		if (!expect(edf.pick_next_entity() == &a, "a runs again in its next period")) return false;
+		edf.remove_from_runqueue(a);
+
+		sched_log.message(LogLevel::INFO, "(5) DEADLINE MISSES");
+		edf.add_to_runqueue(b);
+		self_test_clock += ms(30);
+		if (!expect(edf.pick_next_entity() == &b, "b runs in a fresh period")) return false;
+		if (!expect(edf._index.find(b)->misses == 1, "b missed one deadline")) return false;
+		if (!expect(edf._index.find(a)->misses == 0, "a missed no deadlines")) return false;
+		edf.remove_from_runqueue(b);
+		edf.remove_from_runqueue(background);
+
+		sched_log.message(LogLevel::IMPORTANT, "EDF SCHEDULER SELF TEST - COMPLETE");
+		return true;
+	}
+};
+
+EarliestDeadlineFirstScheduler *EarliestDeadlineFirstScheduler::instance;
+uint64_t EarliestDeadlineFirstScheduler::self_test_clock;
+
+bool sched_edf::set_entity_reservation(SchedulingEntity& entity, uint64_t runtime, uint64_t deadline, uint64_t period)
+{
+	EarliestDeadlineFirstScheduler *edf = EarliestDeadlineFirstScheduler::instance;
+
+	if (!edf || &sys.scheduler().algorithm() != edf) {
+		return false;
+	}
+
+	return edf->set_reservation(entity, runtime, deadline, period);
+}
+
+unsigned long sched_edf::entity_deadline_misses(SchedulingEntity& entity)
+{
+	EarliestDeadlineFirstScheduler *edf = EarliestDeadlineFirstScheduler::instance;
+	if (!edf) return 0;
+
+	UniqueIRQLock l;
+
+	EDFEntity *ee = edf->_index.find(entity);
+	return ee ? ee->misses : 0;
+}
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(EarliestDeadlineFirstScheduler);
@@ -0,0 +1,37 @@
+/*
+ * Earliest-Deadline-First Scheduling Algorithm Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef SCHED_EDF_H
+#define SCHED_EDF_H
+
+#include <infos/kernel/sched-entity.h>
+
+namespace sched_edf {
+
+	/**
+	 * Gives a scheduling entity a CPU reservation: it is guaranteed 'runtime' nanoseconds of
+	 * CPU time in every 'period' nanoseconds, completed no later than 'deadline' nanoseconds
+	 * after the start of each period.  This only has an effect when the "edf" scheduling
+	 * algorithm is in use.  Reservations can also be given per process on the command
+	 * line, with sched.edf.
+	 * @param entity The entity to change.
+	 * @param runtime The runtime per period, or zero to remove the reservation.
+	 * @param deadline The relative deadline.  Must satisfy runtime <= deadline <= period.
+	 * @param period The period.
+	 * @return Returns TRUE if the reservation was made, or FALSE if the parameters were
+	 * invalid, the reservation would take total utilisation past 100%, or the "edf"
+	 * algorithm is not active.
+	 */
+	extern bool set_entity_reservation(infos::kernel::SchedulingEntity& entity, uint64_t runtime, uint64_t deadline, uint64_t period);
+
+	/**
+	 * Returns the number of deadlines the entity has missed since its reservation was made.
+	 */
+	extern unsigned long entity_deadline_misses(infos::kernel::SchedulingEntity& entity);
+}
+
+#endif /* SCHED_EDF_H */
@@ -0,0 +1,328 @@
+/*
+ * Multi-Level Feedback Queue Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#include "rbtree.h"
+#include "sched-common.h"
+#include "sched-stats.h"
+#include "slab.h"
+#include <infos/kernel/sched.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace rbtree;
+using namespace sched_common;
+
+/**
+ * The number of priority levels.  Level 0 is the highest priority.
+ */
+#define MLFQ_LEVELS				4
+
+/**
+ * The quantum of the highest priority level, in milliseconds.  The quantum doubles
+ * at each level below it.
+ */
+#define MLFQ_BASE_QUANTUM_MS	10
+
+/**
+ * How often every entity is boosted back to the highest priority level, in milliseconds.
+ */
+#define MLFQ_BOOST_PERIOD_MS	1000
+
+/**
+ * Scheduler-private state for a scheduling entity.
+ */
+struct MLFQEntity {
+	MLFQEntity(SchedulingEntity& entity) : entity(entity), prev(NULL), next(NULL), queued(false), level(0), allotment_used(0), epoch(0) {
+	}
+
+	SlabAllocated;
+
+	SchedulingEntity& entity;
+
+	// Links into the queue for this entity's level.
+	MLFQEntity *prev, *next;
+	bool queued;
+
+	// The priority level, and how much of that level's quantum (in nanoseconds) has
+	// been used.  The usage is kept across sleeps, so that an entity cannot stay at a
+	// high level by blocking just before its quantum expires.
+	unsigned int level;
+	uint64_t allotment_used;
+
+	// The boost epoch in which level and allotment_used were last valid.
+	uint64_t epoch;
+
+	// Link into the entity index, ordered by the address of the scheduling entity.
+	RBLink<MLFQEntity> index_link;
+};
+
+RegisterObjectCache(MLFQEntity, "mlfq-entity");
+
+/**
+ * A queue of entities at one priority level.
+ */
+struct MLFQLevel {
+	MLFQLevel() : head(NULL), tail(NULL) { }
+
+	MLFQEntity *head, *tail;
+
+	void link_tail(MLFQEntity *me)
+	{
+		me->prev = tail;
+		me->next = NULL;
+
+		if (tail) {
+			tail->next = me;
+		} else {
+			head = me;
+		}
+
+		tail = me;
+	}
+
+	void unlink(MLFQEntity *me)
+	{
+		if (me->prev) {
+			me->prev->next = me->next;
+		} else {
+			head = me->next;
+		}
+
+		if (me->next) {
+			me->next->prev = me->prev;
+		} else {
+			tail = me->prev;
+		}
+
+		me->prev = NULL;
+		me->next = NULL;
+	}
+
+	/**
+	 * Moves every entity in another level onto the end of this one.
+	 */
+	void splice_tail(MLFQLevel& other)
+	{
+		if (!other.head) return;
+
+		if (tail) {
+			tail->next = other.head;
+			other.head->prev = tail;
+		} else {
+			head = other.head;
+		}
+
+		tail = other.tail;
+
+		other.head = NULL;
+		other.tail = NULL;
+	}
+};
+
+/**
+ * A multi-level feedback queue scheduling algorithm.  Entities start at the highest
+ * priority level, and are demoted a level each time they use up that level's quantum,
+ * so CPU-bound entities sink and interactive entities stay near the top.  Lower levels
+ * have longer quanta.  Every entity is periodically boosted back to the top, so that
+ * nothing starves.
+ */
+class MultiLevelFeedbackQueueScheduler : public SchedulingAlgorithm
+{
+public:
+	MultiLevelFeedbackQueueScheduler() : _nr_queued(0), _current(NULL), _current_start(0), _epoch(0), _last_boost(0) { }
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "mlfq"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		MLFQEntity *me = lookup(entity);
+		if (me->queued) return;
+
+		_levels[level_of(me)].link_tail(me);
+		me->queued = true;
+		_nr_queued++;
+
+		sched_stats::entity_woken(entity);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		MLFQEntity *me = _index.find(entity);
+		if (!me || !me->queued) return;
+
+		if (me == _current) {
+			charge(now());
+			_current = NULL;
+		}
+
+		_levels[level_of(me)].unlink(me);
+		me->queued = false;
+		_nr_queued--;
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  The next eligible entity might actually be the same entity, if
+	 * e.g. its timeslice has not expired.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		uint64_t ts = now();
+
+		if (_current) {
+			uint64_t elapsed = ts - _current_start;
+			charge(ts);
+
+			// Demote the running entity if it has used up its quantum.  It goes to the
+			// back of the queue it lands in, whether or not it actually moved down.
+			unsigned int level = level_of(_current);
+			if (_current->allotment_used >= quantum(level)) {
+				_levels[level].unlink(_current);
+
+				if (level < MLFQ_LEVELS - 1) {
+					level++;
+				}
+
+				_current->level = level;
+				_current->allotment_used = 0;
+				_levels[level].link_tail(_current);
+			} else if (elapsed == 0) {
+				// Only the timer tick moves the runtime on, so an event at which no time
+				// has passed since the entity started running is a yield.  The entity goes
+				// to the back of its level, keeping what it has used of its quantum.
+				_levels[level].unlink(_current);
+				_levels[level].link_tail(_current);
+			}
+		}
+
+		if ((ts - _last_boost) >= boost_period()) {
+			boost(ts);
+		}
+
+		// Run the entity at the front of the highest non-empty level.  A running entity
+		// that has not used its quantum is still at the front of its level, so it keeps
+		// the CPU unless a higher level has become non-empty.
+		MLFQEntity *next = NULL;
+		for (unsigned int i = 0; i < MLFQ_LEVELS; i++) {
+			if (_levels[i].head) {
+				next = _levels[i].head;
+				break;
+			}
+		}
+
+		if (next != _current) {
+			_current = next;
+			_current_start = ts;
+		}
+
+		sched_stats::entity_picked(next ? &next->entity : NULL, _nr_queued);
+		return next ? &next->entity : NULL;
+	}
+
+private:
+	MLFQLevel _levels[MLFQ_LEVELS];
+	unsigned int _nr_queued;
+
+	// Every entity this scheduler has seen, ordered by entity address.
+	EntityIndex<MLFQEntity> _index;
+
+	MLFQEntity *_current;
+	uint64_t _current_start;
+
+	// The current boost epoch, and when it started.
+	uint64_t _epoch;
+	uint64_t _last_boost;
+
+	static uint64_t quantum(unsigned int level)
+	{
+		return ((uint64_t)MLFQ_BASE_QUANTUM_MS * 1000000) << level;
+	}
+
+	static uint64_t boost_period()
+	{
+		return (uint64_t)MLFQ_BOOST_PERIOD_MS * 1000000;
+	}
+
+	/**
+	 * Returns the level of an entity.  Entities that have not been touched since the
+	 * last boost are reset to the top level here, rather than during the boost.
+	 */
+	unsigned int level_of(MLFQEntity *me)
+	{
+		if (me->epoch != _epoch) {
+			me->epoch = _epoch;
+			me->level = 0;
+			me->allotment_used = 0;
+		}
+
+		return me->level;
+	}
+
+	/**
+	 * Charges the running entity for the time since it was last charged.
+	 */
+	void charge(uint64_t ts)
+	{
+		level_of(_current);
+
+		_current->allotment_used += ts - _current_start;
+		_current_start = ts;
+	}
+
+	/**
+	 * Moves every entity back to the highest priority level.  The queues are spliced
+	 * in order, so entities keep their relative order, and the per-entity state is
+	 * reset lazily by starting a new epoch.
+	 */
+	void boost(uint64_t ts)
+	{
+		for (unsigned int i = 1; i < MLFQ_LEVELS; i++) {
+			_levels[0].splice_tail(_levels[i]);
+		}
+
+		_epoch++;
+		_last_boost = ts;
+	}
+
+	/**
+	 * Returns the scheduler-private state for an entity, creating it if the entity has
+	 * not been seen before.  New entities start at the highest priority level.
+	 */
+	MLFQEntity *lookup(SchedulingEntity& entity)
+	{
+		MLFQEntity *me = _index.find(entity);
+
+		if (!me) {
+			me = _index.create(entity);
+			me->epoch = _epoch;
+		}
+
+		return me;
+	}
+};
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(MultiLevelFeedbackQueueScheduler);
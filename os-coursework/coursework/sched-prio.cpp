@@ -0,0 +1,630 @@
+/*
+ * Priority Class Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#include "sched-prio.h"
+#include "sched-class.h"
+#include "sched-cfs-rb.h"
+#include "sched-stats.h"
+#include "rbtree.h"
+#include "sched-common.h"
+#include "slab.h"
+#include <infos/kernel/sched.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+#include <infos/util/string.h>
+#include <infos/util/cmdline.h>
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace rbtree;
+using namespace sched_common;
+using namespace sched_prio;
+
+/**
+ * The timeslice given to round-robin real-time and idle entities, in milliseconds.
+ */
+#define RR_TIMESLICE_MS		100
+
+/**
+ * Maps nice values (-20 to 19) to load weights.  Each step is roughly a 10% change in
+ * CPU share, and nice 0 maps to NICE_0_WEIGHT.  This is the table used by Linux.
+ */
+static const uint64_t nice_to_weight[40] = {
+	/* -20 */ 88761, 71755, 56483, 46273, 36291,
+	/* -15 */ 29154, 23254, 18705, 14949, 11916,
+	/* -10 */ 9548, 7620, 6100, 4904, 3906,
+	/*  -5 */ 3121, 2501, 1991, 1586, 1277,
+	/*   0 */ 1024, 820, 655, 526, 423,
+	/*   5 */ 335, 272, 215, 172, 137,
+	/*  10 */ 110, 87, 70, 56, 45,
+	/*  15 */ 36, 29, 23, 18, 15,
+};
+
+/**
+ * Policies for entities, given on the command line as rules of the form name:policy[:param],
+ * e.g. "sched.policy=shell:fifo:50,indexer:idle".  The policy is one of fifo, rr, normal or
+ * idle, and the parameter is as for set_entity_policy().  A rule is applied when the
+ * scheduler first sees an entity of the named process.
+ */
+static char policy_rules[64];
+static bool do_self_test;
+
+RegisterCmdLineArgument(SchedPolicy, "sched.policy") {
+	strncpy(policy_rules, value, sizeof(policy_rules) - 1);
+}
+
+RegisterCmdLineArgument(SchedPrioSelfTest, "sched.prio-self-test") {
+	do_self_test = (strncmp(value, "1", 2) == 0);
+}
+
+/**
+ * Parses the fields of a policy rule.
+ * @param fields The fields, following the process name.
+ * @param policy Receives the policy.
+ * @param param Receives the parameter, which defaults to zero.
+ * @return Returns FALSE if the rule is malformed.
+ */
+static bool parse_policy_rule(const char *fields, SchedulingPolicy::SchedulingPolicy& policy, int& param)
+{
+	char field[16];
+
+	if (!next_rule_field(fields, field, sizeof(field))) {
+		return false;
+	}
+
+	if (strncmp(field, "fifo", sizeof(field)) == 0) {
+		policy = SchedulingPolicy::REALTIME_FIFO;
+	} else if (strncmp(field, "rr", sizeof(field)) == 0) {
+		policy = SchedulingPolicy::REALTIME_RR;
+	} else if (strncmp(field, "normal", sizeof(field)) == 0) {
+		policy = SchedulingPolicy::NORMAL;
+	} else if (strncmp(field, "idle", sizeof(field)) == 0) {
+		policy = SchedulingPolicy::IDLE;
+	} else {
+		return false;
+	}
+
+	param = 0;
+
+	if (next_rule_field(fields, field, sizeof(field))) {
+		int64_t value;
+		if (!parse_decimal(field, value)) {
+			return false;
+		}
+
+		param = (int)value;
+	}
+
+	return true;
+}
+
+/**
+ * Scheduler-private state for an entity in a strict-priority class.
+ */
+struct PrioEntity {
+	PrioEntity(SchedulingEntity& entity) : entity(entity), priority(0), round_robin(true), queued(false), slice_used(0) {
+	}
+
+	SlabAllocated;
+
+	SchedulingEntity& entity;
+
+	unsigned int priority;
+	bool round_robin;
+	bool queued;
+
+	// The amount of the current timeslice (in nanoseconds) that has been used.
+	uint64_t slice_used;
+
+	// Link into the runqueue, ordered by priority.
+	RBLink<PrioEntity> queue_link;
+
+	// Link into the entity index, ordered by the address of the scheduling entity.
+	RBLink<PrioEntity> index_link;
+};
+
+RegisterObjectCache(PrioEntity, "prio-rt-entity");
+
+struct PrioQueueOrder {
+	static bool less(const PrioEntity *l, const PrioEntity *r) {
+		return l->priority > r->priority;
+	}
+};
+
+/**
+ * A strict-priority scheduling class.  The highest priority runnable entity always
+ * runs.  Entities of equal priority run in FIFO order -- a FIFO entity runs until it
+ * blocks, and a round-robin entity moves to the back of its priority level when its
+ * timeslice expires or it yields.
+ */
+class StrictPriorityScheduler : public SchedulingClass
+{
+public:
+	StrictPriorityScheduler(const char *name) : _name(name), _current(NULL), _current_start(0) { }
+
+	const char* name() const override { return _name; }
+
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		PrioEntity *pe = _index.lookup(entity);
+		if (pe->queued) return;
+
+		_queue.insert(pe);
+		pe->queued = true;
+	}
+
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		PrioEntity *pe = _index.find(entity);
+		if (!pe || !pe->queued) return;
+
+		_queue.remove(pe);
+		pe->queued = false;
+
+		// An entity that blocks gives up the rest of its timeslice.
+		if (pe == _current) {
+			pe->slice_used = 0;
+			_current = NULL;
+		}
+	}
+
+	SchedulingEntity *pick_next_entity() override
+	{
+		uint64_t ts = now();
+
+		if (_current) {
+			uint64_t elapsed = ts - _current_start;
+			charge(ts);
+
+			// A round-robin entity moves to the back of its priority level when its timeslice
+			// expires, or when it yields.  Only the timer tick moves the runtime on, so an
+			// event at which no time has passed since the entity started running is a yield.
+			if (_current->round_robin && (elapsed == 0 || _current->slice_used >= timeslice())) {
+				_current->slice_used = 0;
+
+				_queue.remove(_current);
+				_queue.insert(_current);
+			}
+		}
+
+		PrioEntity *next = _queue.leftmost();
+
+		if (next != _current) {
+			_current = next;
+			_current_start = ts;
+		}
+
+		return next ? &next->entity : NULL;
+	}
+
+	void put_prev_entity() override
+	{
+		if (_current) {
+			charge(now());
+			_current = NULL;
+		}
+	}
+
+	/**
+	 * Sets the priority and policy of an entity in this class.
+	 * @param entity The entity to change.
+	 * @param priority The priority, where higher values run first.
+	 * @param round_robin TRUE if the entity should be time-sliced with other entities
+	 * of the same priority, FALSE if it should run until it blocks.
+	 */
+	void set_priority(SchedulingEntity& entity, unsigned int priority, bool round_robin)
+	{
+		UniqueIRQLock l;
+
+		PrioEntity *pe = _index.lookup(entity);
+
+		if (pe->queued) {
+			_queue.remove(pe);
+			pe->priority = priority;
+			_queue.insert(pe);
+		} else {
+			pe->priority = priority;
+		}
+
+		pe->round_robin = round_robin;
+	}
+
+private:
+	const char *_name;
+
+	// The runqueue, ordered by priority.
+	RBTree<PrioEntity, &PrioEntity::queue_link, PrioQueueOrder> _queue;
+
+	// Every entity this class has seen, ordered by entity address.
+	EntityIndex<PrioEntity> _index;
+
+	PrioEntity *_current;
+	uint64_t _current_start;
+
+	static uint64_t timeslice()
+	{
+		return (uint64_t)RR_TIMESLICE_MS * 1000000;
+	}
+
+	void charge(uint64_t ts)
+	{
+		_current->slice_used += ts - _current_start;
+		_current_start = ts;
+	}
+};
+
+/**
+ * The scheduling class membership of an entity.
+ */
+struct ClassEntity {
+	ClassEntity(SchedulingEntity& entity) : entity(entity), policy(SchedulingPolicy::NORMAL), queued(false) {
+	}
+
+	SlabAllocated;
+
+	SchedulingEntity& entity;
+
+	SchedulingPolicy::SchedulingPolicy policy;
+	bool queued;
+
+	// Link into the entity index, ordered by the address of the scheduling entity.
+	RBLink<ClassEntity> index_link;
+};
+
+RegisterObjectCache(ClassEntity, "prio-class-entity");
+
+/**
+ * A layered scheduling algorithm, with strict priority between the scheduling classes:
+ * real-time (FIFO and round-robin), then normal (completely fair, weighted by nice
+ * value), then idle.  A class only runs when every class above it has nothing to run.
+ * New entities start in the normal class at nice 0.
+ */
+class PriorityClassScheduler : public SchedulingAlgorithm
+{
+	friend bool sched_prio::set_entity_policy(SchedulingEntity&, SchedulingPolicy::SchedulingPolicy, int);
+
+public:
+	/**
+	 * Constructs a new instance of the algorithm.
+	 * @param registered TRUE if this instance is driven directly by the Scheduler.  Other
+	 * instances, such as the self-test's, neither report to sched_stats nor apply the
+	 * policy rules from the command line.
+	 */
+	PriorityClassScheduler(bool registered = true) : _rt("rt"), _fair(false), _idle("idle"), _active(NULL), _nr_queued(0), _registered(registered)
+	{
+		_classes[0] = &_rt;
+		_classes[1] = &_fair;
+		_classes[2] = &_idle;
+
+		if (registered) {
+			instance = this;
+		}
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "prio"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		// The self-test needs the memory manager, which is up by the time the first
+		// entity (the idle thread) is added.
+		if (_registered && do_self_test) {
+			do_self_test = false;
+
+			if (!self_test()) {
+				sched_log.message(LogLevel::FATAL, "Priority class scheduler self-test failed!");
+				arch_abort();
+			}
+		}
+
+		ClassEntity *ce = _index.find(entity);
+		if (!ce) {
+			ce = _index.create(entity);
+
+			if (_registered) {
+				apply_policy_rule(entity);
+			}
+		}
+
+		if (ce->queued) return;
+
+		class_of(ce).add_to_runqueue(entity);
+		ce->queued = true;
+		_nr_queued++;
+
+		if (_registered) {
+			sched_stats::entity_woken(entity);
+		}
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		ClassEntity *ce = _index.find(entity);
+		if (!ce || !ce->queued) return;
+
+		class_of(ce).remove_from_runqueue(entity);
+		ce->queued = false;
+		_nr_queued--;
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  The highest class with a runnable entity chooses.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		for (unsigned int i = 0; i < ARRAY_SIZE(_classes); i++) {
+			SchedulingEntity *next = _classes[i]->pick_next_entity();
+
+			if (next) {
+				// If a lower class was running, it has just been preempted.
+				if (_active && _active != _classes[i]) {
+					_active->put_prev_entity();
+				}
+
+				_active = _classes[i];
+
+				if (_registered) {
+					sched_stats::entity_picked(next, _nr_queued);
+				}
+
+				return next;
+			}
+		}
+
+		_active = NULL;
+
+		if (_registered) {
+			sched_stats::entity_picked(NULL, 0);
+		}
+
+		return NULL;
+	}
+
+	static PriorityClassScheduler *instance;
+
+private:
+	StrictPriorityScheduler _rt;
+	RBCompletelyFairScheduler _fair;
+	StrictPriorityScheduler _idle;
+
+	// The classes, in order of priority.
+	SchedulingClass *_classes[3];
+
+	// The class that picked the running entity.
+	SchedulingClass *_active;
+
+	unsigned int _nr_queued;
+	bool _registered;
+
+	// Every entity this scheduler has seen, ordered by entity address.
+	EntityIndex<ClassEntity> _index;
+
+	SchedulingClass& class_of(const ClassEntity *ce)
+	{
+		switch (ce->policy) {
+		case SchedulingPolicy::REALTIME_FIFO:
+		case SchedulingPolicy::REALTIME_RR:
+			return _rt;
+
+		case SchedulingPolicy::IDLE:
+			return _idle;
+
+		default:
+			return _fair;
+		}
+	}
+
+	bool set_policy(SchedulingEntity& entity, SchedulingPolicy::SchedulingPolicy policy, int param)
+	{
+		switch (policy) {
+		case SchedulingPolicy::REALTIME_FIFO:
+		case SchedulingPolicy::REALTIME_RR:
+			if (param < MIN_RT_PRIORITY || param > MAX_RT_PRIORITY) return false;
+			break;
+
+		case SchedulingPolicy::NORMAL:
+			if (param < MIN_NICE || param > MAX_NICE) return false;
+			break;
+
+		case SchedulingPolicy::IDLE:
+			break;
+
+		default:
+			return false;
+		}
+
+		UniqueIRQLock l;
+
+		ClassEntity *ce = _index.lookup(entity);
+
+		// Take the entity out of its current class while its parameters change.
+		bool was_queued = ce->queued;
+		if (was_queued) {
+			class_of(ce).remove_from_runqueue(entity);
+		}
+
+		ce->policy = policy;
+
+		switch (policy) {
+		case SchedulingPolicy::REALTIME_FIFO:
+		case SchedulingPolicy::REALTIME_RR:
+			_rt.set_priority(entity, param, policy == SchedulingPolicy::REALTIME_RR);
+			break;
+
+		case SchedulingPolicy::NORMAL:
+			_fair.set_weight(entity, nice_to_weight[param - MIN_NICE]);
+			break;
+
+		default:
+			break;
+		}
+
+		if (was_queued) {
+			class_of(ce).add_to_runqueue(entity);
+		}
+
+		sched_log.messagef(LogLevel::DEBUG, "Entity %p policy=%d param=%d", &entity, policy, param);
+		return true;
+	}
+
+	/**
+	 * Applies the policy rule for the process an entity belongs to, if there is one.
+	 */
+	void apply_policy_rule(SchedulingEntity& entity)
+	{
+		if (!policy_rules[0]) return;
+
+		const char *fields = find_entity_rule(policy_rules, entity);
+		if (!fields) return;
+
+		SchedulingPolicy::SchedulingPolicy policy;
+		int param;
+
+		if (!parse_policy_rule(fields, policy, param) || !set_policy(entity, policy, param)) {
+			sched_log.messagef(LogLevel::WARNING, "Invalid scheduling policy rule for entity %p", &entity);
+		}
+	}
+
+	/**
+	 * A scheduling entity that is only ever queued and picked, for the self-test.
+	 */
+	struct TestEntity : public SchedulingEntity {
+		bool activate(SchedulingEntity *prev) override { return false; }
+	};
+
+	static bool expect(bool condition, const char *what)
+	{
+		if (!condition) {
+			sched_log.messagef(LogLevel::ERROR, "Self-test check failed: %s", what);
+		}
+
+		return condition;
+	}
+
+	/**
+	 * Checks the rule parser, and the ordering between and within the scheduling classes,
+	 * on a private instance of the algorithm.  No time passes while the test runs, so
+	 * timeslice expiry and the fair share between nice values are not covered.  The
+	 * test instance's records are not reclaimed, as the classes never free records.
+	 * @return Returns TRUE if every check passed.
+	 */
+	static bool self_test()
+	{
+		sched_log.message(LogLevel::IMPORTANT, "PRIO SCHEDULER SELF TEST - BEGIN");
+
+		SchedulingPolicy::SchedulingPolicy policy;
+		int param;
+
+		sched_log.message(LogLevel::INFO, "(1) PARSING POLICY RULES");
+		if (!expect(parse_policy_rule("fifo:50", policy, param) && policy == SchedulingPolicy::REALTIME_FIFO && param == 50, "fifo:50")) return false;
+		if (!expect(parse_policy_rule("rr:10", policy, param) && policy == SchedulingPolicy::REALTIME_RR && param == 10, "rr:10")) return false;
+		if (!expect(parse_policy_rule("normal:-5", policy, param) && policy == SchedulingPolicy::NORMAL && param == -5, "normal:-5")) return false;
+		if (!expect(parse_policy_rule("idle,other:fifo:1", policy, param) && policy == SchedulingPolicy::IDLE && param == 0, "idle")) return false;
+		if (!expect(!parse_policy_rule("batch:1", policy, param), "unknown policy is rejected")) return false;
+		if (!expect(!parse_policy_rule("rr:x", policy, param), "bad parameter is rejected")) return false;
+
+		PriorityClassScheduler prio(false);
+		TestEntity normal, idle, fifo_a, fifo_b, rr, rr_b;
+
+		sched_log.message(LogLevel::INFO, "(2) SETTING POLICIES");
+		if (!expect(!prio.set_policy(fifo_a, SchedulingPolicy::REALTIME_FIFO, 0), "real-time priority 0 is rejected")) return false;
+		if (!expect(!prio.set_policy(normal, SchedulingPolicy::NORMAL, MAX_NICE + 1), "nice 20 is rejected")) return false;
+		if (!expect(prio.set_policy(normal, SchedulingPolicy::NORMAL, 0), "normal:0")) return false;
+		if (!expect(prio.set_policy(idle, SchedulingPolicy::IDLE, 0), "idle")) return false;
+		if (!expect(prio.set_policy(fifo_a, SchedulingPolicy::REALTIME_FIFO, 50), "fifo:50")) return false;
+		if (!expect(prio.set_policy(fifo_b, SchedulingPolicy::REALTIME_FIFO, 50), "fifo:50")) return false;
+		if (!expect(prio.set_policy(rr, SchedulingPolicy::REALTIME_RR, 10), "rr:10")) return false;
+		if (!expect(prio.set_policy(rr_b, SchedulingPolicy::REALTIME_RR, 10), "rr:10")) return false;
+
+		sched_log.message(LogLevel::INFO, "(3) IDLE RUNS ONLY WHEN NOTHING ELSE CAN");
+		prio.add_to_runqueue(idle);
+		if (!expect(prio.pick_next_entity() == &idle, "idle runs alone")) return false;
+		prio.add_to_runqueue(normal);
+		if (!expect(prio.pick_next_entity() == &normal, "normal preempts idle")) return false;
+
+		sched_log.message(LogLevel::INFO, "(4) REAL-TIME RUNS BY PRIORITY");
+		prio.add_to_runqueue(rr);
+		if (!expect(prio.pick_next_entity() == &rr, "rr preempts normal")) return false;
+		prio.add_to_runqueue(fifo_a);
+		if (!expect(prio.pick_next_entity() == &fifo_a, "fifo:50 preempts rr:10")) return false;
+
+		sched_log.message(LogLevel::INFO, "(5) FIFO RUNS UNTIL IT BLOCKS");
+		prio.add_to_runqueue(fifo_b);
+		if (!expect(prio.pick_next_entity() == &fifo_a, "fifo keeps the CPU from an equal priority")) return false;
+		if (!expect(prio.pick_next_entity() == &fifo_a, "fifo keeps the CPU from an equal priority")) return false;
+		prio.remove_from_runqueue(fifo_a);
+		if (!expect(prio.pick_next_entity() == &fifo_b, "next fifo runs when the first blocks")) return false;
+
+		sched_log.message(LogLevel::INFO, "(6) LOWER CLASSES RUN AS HIGHER ONES EMPTY");
+		prio.remove_from_runqueue(fifo_b);
+		if (!expect(prio.pick_next_entity() == &rr, "rr runs")) return false;
+		prio.remove_from_runqueue(rr);
+		if (!expect(prio.pick_next_entity() == &normal, "normal runs")) return false;
+		prio.remove_from_runqueue(normal);
+		if (!expect(prio.pick_next_entity() == &idle, "idle runs")) return false;
+		prio.remove_from_runqueue(idle);
+		if (!expect(prio.pick_next_entity() == NULL, "nothing runs")) return false;
+
+		sched_log.message(LogLevel::INFO, "(7) CHANGING POLICY WHILE RUNNABLE");
+		prio.add_to_runqueue(normal);
+		prio.add_to_runqueue(idle);
+		if (!expect(prio.pick_next_entity() == &normal, "normal runs")) return false;
+		if (!expect(prio.set_policy(idle, SchedulingPolicy::REALTIME_FIFO, 1), "idle to fifo:1")) return false;
+		if (!expect(prio.pick_next_entity() == &idle, "promoted entity runs")) return false;
+		prio.remove_from_runqueue(idle);
+		prio.remove_from_runqueue(normal);
+
+		sched_log.message(LogLevel::INFO, "(8) ROUND-ROBIN YIELDS TO AN EQUAL PRIORITY");
+		prio.add_to_runqueue(rr);
+		prio.add_to_runqueue(rr_b);
+		if (!expect(prio.pick_next_entity() == &rr, "first rr runs")) return false;
+		if (!expect(prio.pick_next_entity() == &rr_b, "second rr runs when the first yields")) return false;
+		if (!expect(prio.pick_next_entity() == &rr, "first rr runs when the second yields")) return false;
+		prio.remove_from_runqueue(rr);
+		prio.remove_from_runqueue(rr_b);
+
+		sched_log.message(LogLevel::IMPORTANT, "PRIO SCHEDULER SELF TEST - COMPLETE");
+		return true;
+	}
+};
+
+PriorityClassScheduler *PriorityClassScheduler::instance;
+
+bool sched_prio::set_entity_policy(SchedulingEntity& entity, SchedulingPolicy::SchedulingPolicy policy, int param)
+{
+	PriorityClassScheduler *prio = PriorityClassScheduler::instance;
+
+	if (!prio || &sys.scheduler().algorithm() != prio) {
+		return false;
+	}
+
+	return prio->set_policy(entity, policy, param);
+}
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(PriorityClassScheduler);
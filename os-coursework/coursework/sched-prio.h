@@ -0,0 +1,46 @@
+/*
+ * Priority Class Scheduling Algorithm Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef SCHED_PRIO_H
+#define SCHED_PRIO_H
+
+#include <infos/kernel/sched-entity.h>
+
+namespace sched_prio {
+
+	namespace SchedulingPolicy
+	{
+		enum SchedulingPolicy
+		{
+			REALTIME_FIFO,
+			REALTIME_RR,
+			NORMAL,
+			IDLE,
+		};
+	}
+
+	#define MIN_RT_PRIORITY		1
+	#define MAX_RT_PRIORITY		99
+
+	#define MIN_NICE			-20
+	#define MAX_NICE			19
+
+	/**
+	 * Moves a scheduling entity into a scheduling class.  This only has an effect when
+	 * the "prio" scheduling algorithm is in use.  Policies can also be given per process
+	 * on the command line, with sched.policy.
+	 * @param entity The entity to change.
+	 * @param policy The scheduling policy, which selects the class.
+	 * @param param For the real-time policies, the real-time priority (higher runs first).
+	 * For the normal policy, the nice value.  Ignored for the idle policy.
+	 * @return Returns TRUE if the entity was changed, or FALSE if the parameters were
+	 * invalid, or the "prio" algorithm is not active.
+	 */
+	extern bool set_entity_policy(infos::kernel::SchedulingEntity& entity, SchedulingPolicy::SchedulingPolicy policy, int param);
+}
+
+#endif /* SCHED_PRIO_H */
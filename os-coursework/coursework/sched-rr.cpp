@@ -6,14 +6,69 @@
 /*
  * STUDENT NUMBER: s1346249
  */
+#include "rbtree.h"
+#include "sched-common.h"
+#include "sched-stats.h"
+#include "slab.h"
 #include <infos/kernel/sched.h>
 #include <infos/kernel/thread.h>
+#include <infos/kernel/kernel.h>
 #include <infos/kernel/log.h>
-#include <infos/util/list.h>
 #include <infos/util/lock.h>
+#include <infos/util/cmdline.h>
 
 using namespace infos::kernel;
 using namespace infos::util;
+using namespace rbtree;
+using namespace sched_common;
+
+/**
+ * The default quantum, in milliseconds.  This matches the LAPIC timer period, so by
+ * default an entity is rotated out on every tick.
+ */
+#define DEFAULT_QUANTUM_MS	10
+
+static uint64_t rr_quantum_ms = DEFAULT_QUANTUM_MS;
+
+/**
+ * The longest quantum, in milliseconds, whose length in nanoseconds fits in 64 bits.
+ */
+#define MAX_QUANTUM_MS		(~0ull / 1000000)
+
+RegisterCmdLineArgument(SchedQuantum, "sched.quantum") {
+	int64_t quantum;
+
+	if (!parse_decimal(value, quantum) || quantum <= 0 || (uint64_t)quantum > MAX_QUANTUM_MS) {
+		sched_log.messagef(LogLevel::WARNING, "Invalid scheduling quantum '%s', using %lu ms", value, rr_quantum_ms);
+		return;
+	}
+
+	rr_quantum_ms = quantum;
+}
+
+/**
+ * Scheduler-private state for a scheduling entity, including its runqueue links.
+ */
+struct RREntity {
+	RREntity(SchedulingEntity& entity) : entity(entity), prev(NULL), next(NULL), queued(false), slice_used(0) {
+	}
+
+	SlabAllocated;
+
+	SchedulingEntity& entity;
+
+	// Links into the runqueue.
+	RREntity *prev, *next;
+	bool queued;
+
+	// The amount of the current timeslice (in nanoseconds) that has been used.
+	uint64_t slice_used;
+
+	// Link into the entity index, ordered by the address of the scheduling entity.
+	RBLink<RREntity> index_link;
+};
+
+RegisterObjectCache(RREntity, "rr-entity");
 
 /**
  * A round-robin scheduling algorithm
@@ -21,6 +76,8 @@ using namespace infos::util;
 class RoundRobinScheduler : public SchedulingAlgorithm
 {
 public:
+	RoundRobinScheduler() : _head(NULL), _tail(NULL), _nr_queued(0), _current(NULL), _current_start(0) { }
+
 	/**
 	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
 	 */
@@ -32,7 +89,16 @@ public:
 	 */
 	void add_to_runqueue(SchedulingEntity& entity) override
 	{
-		runqueue.append(&entity);               //adds the entity to the end of the list
+		UniqueIRQLock l;
+
+		RREntity *rre = _index.lookup(entity);
+		if (rre->queued) return;
+
+		link_tail(rre);                         //adds the entity to the end of the runqueue
+		rre->queued = true;
+		_nr_queued++;
+
+		sched_stats::entity_woken(entity);
 	}
 
 	/**
@@ -41,9 +107,20 @@ public:
 	 */
 	void remove_from_runqueue(SchedulingEntity& entity) override
 	{
-        if (!runqueue.empty()) {                //ensures the list is not empty
-            runqueue.remove(&entity);           //removes any element that equals the entity in the list
-        }
+		UniqueIRQLock l;
+
+		RREntity *rre = _index.find(entity);
+		if (!rre || !rre->queued) return;       //ignores entities that are not on the runqueue
+
+		unlink(rre);
+		rre->queued = false;
+		_nr_queued--;
+
+		//an entity that blocks gives up the rest of its timeslice
+		if (rre == _current) {
+			rre->slice_used = 0;
+			_current = NULL;
+		}
 	}
 
 	/**
@@ -53,17 +130,98 @@ public:
 	 */
 	SchedulingEntity *pick_next_entity() override
 	{
-        if (!runqueue.empty()) {                //ensures the list is not empty
-		    runqueue.append(runqueue.first());  //adds the first entity to the end of the list
-            return runqueue.pop();              //returns the first entity and removes it from the start of the list
-        } else {
+		uint64_t ts = now();
+
+		//keeps running the current entity until its timeslice is used up.  Only the timer
+		//tick moves the runtime on, so an event at which no time has passed since the
+		//entity started running is a yield, and gives up the rest of the timeslice
+		if (_current) {
+			uint64_t elapsed = ts - _current_start;
+
+			_current->slice_used += elapsed;
+			_current_start = ts;
+
+			if (elapsed > 0 && _current->slice_used < quantum()) {
+				sched_stats::entity_picked(&_current->entity, _nr_queued);
+				return &_current->entity;
+			}
+
+			_current->slice_used = 0;
+			_current = NULL;
+		}
+
+		if (!_head) {                           //the runqueue is empty
+			sched_stats::entity_picked(NULL, 0);
 			return NULL;
 		}
+
+		RREntity *next = _head;
+
+		//rotates the first entity to the end of the runqueue
+		if (next != _tail) {
+			unlink(next);
+			link_tail(next);
+		}
+
+		_current = next;
+		_current_start = ts;
+
+		sched_stats::entity_picked(&next->entity, _nr_queued);
+		return &next->entity;
 	}
 
 private:
-	// A list containing the current runqueue.
-	List<SchedulingEntity *> runqueue;
+	// The runqueue, as an intrusive doubly-linked list of entity records.
+	RREntity *_head, *_tail;
+	unsigned int _nr_queued;
+
+	// Every entity this scheduler has seen, so that the record for an entity can be
+	// found without searching the runqueue.
+	EntityIndex<RREntity> _index;
+
+	// The entity that was last picked, and the time its current run started.
+	RREntity *_current;
+	uint64_t _current_start;
+
+	/**
+	 * Returns the length of a timeslice, in nanoseconds.
+	 */
+	static uint64_t quantum()
+	{
+		return rr_quantum_ms * 1000000;
+	}
+
+	void link_tail(RREntity *rre)
+	{
+		rre->prev = _tail;
+		rre->next = NULL;
+
+		if (_tail) {
+			_tail->next = rre;
+		} else {
+			_head = rre;
+		}
+
+		_tail = rre;
+	}
+
+	void unlink(RREntity *rre)
+	{
+		if (rre->prev) {
+			rre->prev->next = rre->next;
+		} else {
+			_head = rre->next;
+		}
+
+		if (rre->next) {
+			rre->next->prev = rre->prev;
+		} else {
+			_tail = rre->prev;
+		}
+
+		rre->prev = NULL;
+		rre->next = NULL;
+	}
 };
 
 /* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
@@ -0,0 +1,291 @@
+/*
+ * Scheduler Statistics
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#include "sched-stats.h"
+#include "cycle-counter.h"
+#include "rbtree.h"
+#include "sched-common.h"
+#include "report-buffer.h"
+#include "slab.h"
+#include <infos/drivers/device.h>
+#include <infos/fs/file.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+#include <infos/util/printf.h>
+#include <infos/util/string.h>
+#include <infos/util/cmdline.h>
+
+using namespace infos::kernel;
+using namespace infos::drivers;
+using namespace infos::fs;
+using namespace infos::util;
+using namespace rbtree;
+using namespace sched_stats;
+using namespace sched_common;
+
+static bool sched_stats_enabled = true;
+
+RegisterCmdLineArgument(SchedStats, "sched.stats") {
+	sched_stats_enabled = (strncmp(value, "0", 1) != 0);
+}
+
+/**
+ * Latencies are timed with the CPU timestamp counter, as the kernel runtime only moves in
+ * whole 10ms ticks.  The counter's rate is found by comparing it with the kernel runtime,
+ * from the first event onwards, and the estimate improves as the runtime grows.  No
+ * latencies are recorded until this has run for CALIBRATION_MS, so that the tick
+ * granularity of the runtime puts the estimate out by at most one tick in CALIBRATION_MS.
+ */
+#define CALIBRATION_MS	100
+
+static bool calibration_started;
+static uint64_t calibration_cycles, calibration_runtime;
+
+/**
+ * Returns the rate of the timestamp counter, in cycles per microsecond, or zero if it has
+ * not been calibrated for long enough.
+ */
+static uint64_t cycles_per_us()
+{
+	uint64_t cycles = read_cycle_counter();
+	uint64_t runtime = now();
+
+	if (!calibration_started) {
+		calibration_started = true;
+		calibration_cycles = cycles;
+		calibration_runtime = runtime;
+
+		return 0;
+	}
+
+	uint64_t elapsed_us = (runtime - calibration_runtime) / 1000;
+	if (elapsed_us < (uint64_t)CALIBRATION_MS * 1000) {
+		return 0;
+	}
+
+	return (cycles - calibration_cycles) / elapsed_us;
+}
+
+void LatencyHistogram::record(uint64_t latency_ns)
+{
+	uint64_t us = latency_ns / 1000;
+
+	unsigned int bucket = 0;
+	while (us >> bucket) {
+		bucket++;
+	}
+
+	if (bucket >= LATENCY_BUCKETS) {
+		bucket = LATENCY_BUCKETS - 1;
+	}
+
+	buckets[bucket]++;
+	count++;
+	total_us += us;
+
+	if (us > max_us) {
+		max_us = us;
+	}
+}
+
+void LatencyHistogram::reset()
+{
+	for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+		buckets[i] = 0;
+	}
+
+	count = 0;
+	total_us = 0;
+	max_us = 0;
+}
+
+/**
+ * Statistics for a single scheduling entity.
+ */
+struct StatEntity {
+	StatEntity(SchedulingEntity& entity) : entity(entity), woken_at(0), waiting(false) {
+		latency.reset();
+	}
+
+	SlabAllocated;
+
+	SchedulingEntity& entity;
+
+	// When the entity last became runnable (in timestamp counter cycles), if it has not
+	// run since.
+	uint64_t woken_at;
+	bool waiting;
+
+	LatencyHistogram latency;
+
+	// Link into the entity index, ordered by the address of the scheduling entity.
+	RBLink<StatEntity> index_link;
+};
+
+RegisterObjectCache(StatEntity, "sched-stat-entity");
+
+static EntityIndex<StatEntity> stat_entities;
+
+static LatencyHistogram global_latency;
+static SchedulingEntity *last_picked;
+static uint64_t context_switches;
+static uint64_t runqueue_samples;
+static uint64_t runqueue_total;
+static uint64_t runqueue_max;
+
+/**
+ * Appends a latency histogram to a report, as a single line.
+ */
+static void append_histogram(ReportBuffer& report, const LatencyHistogram& h)
+{
+	report.appendf("count=%lu total_us=%lu max_us=%lu hist=", h.count, h.total_us, h.max_us);
+
+	for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+		report.appendf(i == 0 ? "%lu" : ",%lu", h.buckets[i]);
+	}
+
+	report.appendf("\n");
+}
+
+/**
+ * An open statistics file.  The report is generated when the file is opened, so that
+ * reads see a consistent snapshot.  Writing anything to the file resets the statistics.
+ */
+class SchedStatsFile : public ReportFile
+{
+public:
+	SchedStatsFile() : ReportFile(1024 * (stat_entities.count() + 4))
+	{
+		UniqueIRQLock l;
+
+		_report.appendf("context_switches %lu\n", context_switches);
+		_report.appendf("runqueue samples=%lu total=%lu max=%lu\n", runqueue_samples, runqueue_total, runqueue_max);
+
+		_report.appendf("latency ");
+		append_histogram(_report, global_latency);
+
+		for (StatEntity *se = stat_entities.first(); se; se = stat_entities.next(se)) {
+			_report.appendf("entity %p ", &se->entity);
+			append_histogram(_report, se->latency);
+		}
+	}
+
+	int write(const void* buffer, size_t size) override
+	{
+		sched_stats::reset();
+		return size;
+	}
+};
+
+/**
+ * A device exposing the scheduler statistics, which appears in devfs as /dev/schedstat0.
+ */
+class SchedStatsDevice : public Device
+{
+public:
+	static const DeviceClass SchedStatsDeviceClass;
+
+	const DeviceClass& device_class() const override { return SchedStatsDeviceClass; }
+
+	File *open_as_file() override
+	{
+		return new SchedStatsFile();
+	}
+};
+
+const DeviceClass SchedStatsDevice::SchedStatsDeviceClass(Device::RootDeviceClass, "schedstat");
+
+static SchedStatsDevice sched_stats_device;
+static bool devices_registered;
+
+/**
+ * Registers the statistics devices, this one and the slab allocator's.  There is no hook
+ * for modules to register devices during boot, so this happens on the first wake-up, which
+ * is the idle thread starting during scheduler initialisation -- before interrupts are
+ * enabled, and before any other thread exists.
+ */
+static void register_devices()
+{
+	devices_registered = true;
+
+	slab::init();
+
+	if (sched_stats_enabled && !sys.device_manager().register_device(sched_stats_device)) {
+		sched_log.message(LogLevel::WARNING, "Unable to register scheduler statistics device");
+	}
+}
+
+void sched_stats::entity_woken(SchedulingEntity& entity)
+{
+	if (!devices_registered) {
+		register_devices();
+	}
+
+	if (!sched_stats_enabled) return;
+
+	UniqueIRQLock l;
+
+	StatEntity *se = stat_entities.lookup(entity);
+
+	se->woken_at = read_cycle_counter();
+	se->waiting = true;
+}
+
+void sched_stats::entity_picked(SchedulingEntity *entity, unsigned int nr_running)
+{
+	if (!sched_stats_enabled) return;
+
+	UniqueIRQLock l;
+
+	runqueue_samples++;
+	runqueue_total += nr_running;
+	if (nr_running > runqueue_max) {
+		runqueue_max = nr_running;
+	}
+
+	if (entity != last_picked) {
+		last_picked = entity;
+
+		if (entity) {
+			context_switches++;
+		}
+	}
+
+	if (!entity) return;
+
+	StatEntity *se = stat_entities.find(*entity);
+
+	if (se && se->waiting) {
+		uint64_t cycles = read_cycle_counter() - se->woken_at;
+		uint64_t rate = cycles_per_us();
+
+		if (rate) {
+			uint64_t latency = (cycles * 1000) / rate;
+
+			se->latency.record(latency);
+			global_latency.record(latency);
+		}
+
+		se->waiting = false;
+	}
+}
+
+void sched_stats::reset()
+{
+	UniqueIRQLock l;
+
+	global_latency.reset();
+	context_switches = 0;
+	runqueue_samples = 0;
+	runqueue_total = 0;
+	runqueue_max = 0;
+
+	for (StatEntity *se = stat_entities.first(); se; se = stat_entities.next(se)) {
+		se->latency.reset();
+	}
+}
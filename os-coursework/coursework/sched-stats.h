@@ -0,0 +1,50 @@
+/*
+ * Scheduler Statistics Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef SCHED_STATS_H
+#define SCHED_STATS_H
+
+#include <infos/kernel/sched-entity.h>
+
+namespace sched_stats {
+
+	/**
+	 * The number of buckets in a latency histogram.  Bucket 0 counts latencies under
+	 * 1us, and bucket i counts latencies in [2^(i-1), 2^i) microseconds.
+	 */
+	#define LATENCY_BUCKETS		32
+
+	struct LatencyHistogram {
+		uint64_t buckets[LATENCY_BUCKETS];
+		uint64_t count;
+		uint64_t total_us;
+		uint64_t max_us;
+
+		void record(uint64_t latency_ns);
+		void reset();
+	};
+
+	/**
+	 * Called by a scheduling algorithm when an entity becomes runnable.
+	 * @param entity The entity that has become runnable.
+	 */
+	extern void entity_woken(infos::kernel::SchedulingEntity& entity);
+
+	/**
+	 * Called by a scheduling algorithm each time it picks the next entity to run.
+	 * @param entity The entity that was picked, or NULL if the runqueue was empty.
+	 * @param nr_running The number of runnable entities at the time of the pick.
+	 */
+	extern void entity_picked(infos::kernel::SchedulingEntity *entity, unsigned int nr_running);
+
+	/**
+	 * Clears all statistics.
+	 */
+	extern void reset();
+}
+
+#endif /* SCHED_STATS_H */
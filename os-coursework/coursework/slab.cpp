@@ -0,0 +1,616 @@
+/*
+ * Slab Object Allocator
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#include "slab.h"
+#include "buddy.h"
+#include "report-buffer.h"
+#include <infos/drivers/device.h>
+#include <infos/fs/file.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/mm/mm.h>
+#include <infos/mm/page-allocator.h>
+#include <infos/mm/object-allocator.h>
+#include <infos/util/lock.h>
+#include <infos/util/printf.h>
+#include <infos/util/string.h>
+#include <infos/util/cmdline.h>
+
+using namespace infos::kernel;
+using namespace infos::drivers;
+using namespace infos::fs;
+using namespace infos::mm;
+using namespace infos::util;
+using namespace slab;
+
+/*
+ * A slab is grown until it holds at least this many objects, up to the largest slab order.
+ */
+#define SLAB_MIN_OBJECTS	8
+#define SLAB_MAX_ORDER		3
+
+/*
+ * The number of objects a magazine holds, and the most magazines the depot keeps.  Any
+ * more full magazines are flushed back to the slabs, and any more empty magazines are freed.
+ */
+#define MAGAZINE_ROUNDS		15
+#define DEPOT_MAX_FULL		4
+#define DEPOT_MAX_EMPTY		4
+
+static bool magazines_enabled = true;
+
+RegisterCmdLineArgument(SlabMagazines, "slab.magazines") {
+	magazines_enabled = strncmp(value, "0", 2) != 0;
+}
+
+/**
+ * The header at the start of every slab.
+ */
+struct ObjectCache::Slab {
+	ObjectCache *cache;
+	Slab *prev, *next;
+
+	// The free objects in this slab, linked through each object's free-list link.
+	void *free_objects;
+	unsigned int in_use;
+};
+
+/**
+ * A magazine: a stack of free objects, which is either loaded into the CPU layer or held
+ * in the depot.
+ */
+struct ObjectCache::Magazine {
+	Magazine *next;
+	unsigned int rounds;
+	void *objects[MAGAZINE_ROUNDS];
+};
+
+static ObjectCache *caches;
+
+ObjectCache::ObjectCache(const char *name, size_t object_size, Constructor ctor, unsigned int flags)
+	: _name(name), _object_size(object_size), _ctor(ctor),
+	  _partial(NULL), _full(NULL), _nr_slabs(0), _nr_empty_slabs(0),
+	  _nr_active(0), _nr_allocs(0), _nr_hits(0), _nr_frees(0), _nr_grows(0), _nr_shrinks(0),
+	  _bytes_requested(0),
+	  _use_magazines(!(flags & OBJECT_CACHE_NO_MAGAZINES)), _loaded(NULL), _previous(NULL),
+	  _depot_full(NULL), _depot_empty(NULL), _nr_depot_full(0), _nr_depot_empty(0),
+	  _nr_cached(0), _nr_magazine_allocs(0), _nr_magazine_frees(0), _nr_depot_exchanges(0)
+{
+	// Objects hold at least a free-list link, and anything bigger than that is kept
+	// sixteen-byte aligned.
+	size_t size = object_size < sizeof(void *) ? sizeof(void *) : object_size;
+	size_t align = size > sizeof(void *) ? 16 : sizeof(void *);
+
+	size = __align_up(size, align);
+
+	// A constructed object must survive being freed, so its link goes after it.
+	if (ctor) {
+		size_t linked_size = size + sizeof(void *);
+
+		_link_offset = size;
+		_stride = __align_up(linked_size, align);
+	} else {
+		_link_offset = 0;
+		_stride = size;
+	}
+
+	_first_object_offset = __align_up(sizeof(Slab), align);
+
+	// Pick the smallest slab that holds enough objects.  A slab is taken with
+	// buddy::alloc_pages_exact(), so it is aligned to the next power of two pages, which
+	// slab_of() relies on, but need not fill that block.
+	for (_slab_pages = 1; _slab_pages < (1u << SLAB_MAX_ORDER); _slab_pages++) {
+		if ((((size_t)__page_size * _slab_pages) - _first_object_offset) / _stride >= SLAB_MIN_OBJECTS) {
+			break;
+		}
+	}
+
+	_slab_order = 0;
+	while ((1u << _slab_order) < _slab_pages) {
+		_slab_order++;
+	}
+
+	_objects_per_slab = (((size_t)__page_size * _slab_pages) - _first_object_offset) / _stride;
+	assert(_objects_per_slab > 0);
+
+	_next_cache = caches;
+	caches = this;
+}
+
+ObjectCache::Slab *ObjectCache::slab_of(void *object) const
+{
+	return (Slab *)((uintptr_t)object & ~(((uintptr_t)__page_size << _slab_order) - 1));
+}
+
+void ObjectCache::unlink(Slab *&list, Slab *slab)
+{
+	if (slab->prev) {
+		slab->prev->next = slab->next;
+	} else {
+		list = slab->next;
+	}
+
+	if (slab->next) {
+		slab->next->prev = slab->prev;
+	}
+
+	slab->prev = NULL;
+	slab->next = NULL;
+}
+
+void ObjectCache::push(Slab *&list, Slab *slab)
+{
+	slab->prev = NULL;
+	slab->next = list;
+
+	if (list) {
+		list->prev = slab;
+	}
+
+	list = slab;
+}
+
+/**
+ * Takes a new slab from the buddy allocator, and fills its free list.  Slabs are grown with
+ * the IRQ lock held, so their pages only come through buddy.h, which is safe to call
+ * there, and never through the page allocator, which may wait on its mutex.
+ * @return Returns the new slab, or NULL if no memory is available.
+ */
+ObjectCache::Slab *ObjectCache::grow()
+{
+	const PageDescriptor *pgd = buddy::alloc_pages_exact(_slab_pages);
+	if (!pgd) {
+		return NULL;
+	}
+
+	Slab *slab = (Slab *)sys.mm().pgalloc().pgd_to_vpa(pgd);
+
+	// Exact allocations start on a naturally aligned block, which slab_of() relies on.
+	assert(slab_of(slab) == slab);
+
+	slab->cache = this;
+	slab->free_objects = NULL;
+	slab->in_use = 0;
+
+	// Thread the objects onto the free list back-to-front, so that they are handed out in
+	// address order.
+	uintptr_t first = (uintptr_t)slab + _first_object_offset;
+	for (unsigned int i = _objects_per_slab; i > 0; i--) {
+		void *object = (void *)(first + ((i - 1) * _stride));
+
+		if (_ctor) {
+			_ctor(object);
+		}
+
+		link_of(object) = slab->free_objects;
+		slab->free_objects = object;
+	}
+
+	push(_partial, slab);
+
+	_nr_slabs++;
+	_nr_empty_slabs++;
+	_nr_grows++;
+
+	return slab;
+}
+
+/**
+ * Returns an empty slab to the buddy allocator.
+ */
+void ObjectCache::release(Slab *slab)
+{
+	assert(slab->in_use == 0);
+
+	unlink(_partial, slab);
+
+	buddy::free_pages_exact(sys.mm().pgalloc().vpa_to_pgd((virt_addr_t)slab), _slab_pages);
+
+	_nr_slabs--;
+	_nr_shrinks++;
+}
+
+/**
+ * Allocates an object from the slabs.  The caller must hold the IRQ lock.
+ */
+void *ObjectCache::slab_alloc()
+{
+	Slab *slab = _partial;
+	if (slab) {
+		_nr_hits++;
+	} else {
+		slab = grow();
+		if (!slab) {
+			return NULL;
+		}
+	}
+
+	if (slab->in_use == 0) {
+		_nr_empty_slabs--;
+	}
+
+	void *object = slab->free_objects;
+	slab->free_objects = link_of(object);
+	slab->in_use++;
+
+	// Full slabs are moved out of the way, so the head of the partial list always has
+	// a free object.
+	if (!slab->free_objects) {
+		unlink(_partial, slab);
+		push(_full, slab);
+	}
+
+	_nr_allocs++;
+	_nr_active++;
+
+	return object;
+}
+
+/**
+ * Returns an object to its slab.  The caller must hold the IRQ lock.
+ */
+void ObjectCache::slab_free(void *object)
+{
+	Slab *slab = slab_of(object);
+	assert(slab->cache == this);
+
+	if (!slab->free_objects) {
+		unlink(_full, slab);
+		push(_partial, slab);
+	}
+
+	link_of(object) = slab->free_objects;
+	slab->free_objects = object;
+	slab->in_use--;
+
+	_nr_frees++;
+	_nr_active--;
+
+	// Keep one empty slab around, so that a cache hovering at a slab boundary does not
+	// repeatedly go to the page allocator.
+	if (slab->in_use == 0) {
+		if (_nr_empty_slabs > 0) {
+			release(slab);
+		} else {
+			_nr_empty_slabs++;
+		}
+	}
+}
+
+ObjectCache::Magazine *ObjectCache::pop_magazine(Magazine *&list, unsigned int& count)
+{
+	Magazine *magazine = list;
+
+	if (magazine) {
+		list = magazine->next;
+		magazine->next = NULL;
+		count--;
+	}
+
+	return magazine;
+}
+
+void ObjectCache::push_magazine(Magazine *&list, unsigned int& count, Magazine *magazine)
+{
+	magazine->next = list;
+	list = magazine;
+	count++;
+}
+
+/**
+ * Allocates an object from the magazine layer.  The caller must hold the IRQ lock.
+ * @param object Receives the object.
+ * @return Returns TRUE if an object was allocated, or FALSE if the magazine layer is empty.
+ */
+bool ObjectCache::magazine_alloc(void *&object)
+{
+	if (!_loaded || !_loaded->rounds) {
+		if (_previous && _previous->rounds) {
+			// The previous magazine is full, so swap it in.
+			Magazine *full = _previous;
+			_previous = _loaded;
+			_loaded = full;
+		} else if (_depot_full) {
+			// Both magazines are empty.  Give the previous one to the depot, in exchange
+			// for a full one.
+			if (_previous) {
+				push_magazine(_depot_empty, _nr_depot_empty, _previous);
+
+				if (_nr_depot_empty > DEPOT_MAX_EMPTY) {
+					_magazine_cache.free(pop_magazine(_depot_empty, _nr_depot_empty));
+				}
+			}
+
+			_previous = _loaded;
+			_loaded = pop_magazine(_depot_full, _nr_depot_full);
+			_nr_depot_exchanges++;
+		} else {
+			return false;
+		}
+	}
+
+	object = _loaded->objects[--_loaded->rounds];
+
+	_nr_cached--;
+	_nr_magazine_allocs++;
+
+	return true;
+}
+
+/**
+ * Frees an object into the magazine layer.  The caller must hold the IRQ lock.
+ * @param object The object to free.
+ * @return Returns TRUE if the object was taken, or FALSE if it must go back to its slab.
+ */
+bool ObjectCache::magazine_free(void *object)
+{
+	if (!_loaded || _loaded->rounds == MAGAZINE_ROUNDS) {
+		if (_previous && !_previous->rounds) {
+			// The previous magazine is empty, so swap it in.
+			Magazine *empty = _previous;
+			_previous = _loaded;
+			_loaded = empty;
+		} else if (_previous && _nr_depot_full >= DEPOT_MAX_FULL) {
+			// Both magazines are full, and so is the depot.  Return the previous magazine's
+			// objects to the slabs, and reuse it.
+			for (unsigned int i = 0; i < _previous->rounds; i++) {
+				slab_free(_previous->objects[i]);
+			}
+
+			_nr_cached -= _previous->rounds;
+			_previous->rounds = 0;
+
+			Magazine *empty = _previous;
+			_previous = _loaded;
+			_loaded = empty;
+		} else {
+			// Exchange the previous magazine for an empty one from the depot, or a new one.
+			Magazine *empty = pop_magazine(_depot_empty, _nr_depot_empty);
+
+			if (!empty) {
+				empty = (Magazine *)_magazine_cache.alloc();
+				if (!empty) {
+					return false;
+				}
+
+				empty->next = NULL;
+				empty->rounds = 0;
+			}
+
+			if (_previous) {
+				push_magazine(_depot_full, _nr_depot_full, _previous);
+			}
+
+			_previous = _loaded;
+			_loaded = empty;
+			_nr_depot_exchanges++;
+		}
+	}
+
+	_loaded->objects[_loaded->rounds++] = object;
+
+	_nr_cached++;
+	_nr_magazine_frees++;
+
+	return true;
+}
+
+void *ObjectCache::alloc()
+{
+	// Slabs only come from the buddy allocator.  Under other page allocation algorithms,
+	// objects come from the kernel's object allocator instead, as large generic requests do.
+	if (!buddy::active()) {
+		void *object = sys.mm().objalloc().alloc(_object_size);
+		if (object && _ctor) {
+			_ctor(object);
+		}
+
+		return object;
+	}
+
+	UniqueIRQLock l;
+
+	void *object;
+	if (!(magazines_enabled && _use_magazines && magazine_alloc(object))) {
+		object = slab_alloc();
+	}
+
+	if (object) {
+		_bytes_requested += _object_size;
+	}
+
+	return object;
+}
+
+void ObjectCache::free(void *object)
+{
+	if (!object) return;
+
+	if (!buddy::active()) {
+		sys.mm().objalloc().free(object);
+		return;
+	}
+
+	UniqueIRQLock l;
+
+	_bytes_requested -= _object_size;
+
+	if (!(magazines_enabled && _use_magazines && magazine_free(object))) {
+		slab_free(object);
+	}
+}
+
+void ObjectCache::account_request(size_t requested, bool alloc)
+{
+	if (!buddy::active()) return;
+
+	UniqueIRQLock l;
+
+	if (alloc) {
+		_bytes_requested -= _object_size - requested;
+	} else {
+		_bytes_requested += _object_size - requested;
+	}
+}
+
+int ObjectCache::format_stats(char *buffer, size_t size) const
+{
+	size_t slab_bytes = (size_t)__page_size * _slab_pages;
+	size_t live_bytes = (_nr_active - _nr_cached) * _object_size;
+	uint64_t nr_allocs = _nr_magazine_allocs + _nr_allocs;
+
+	// 'active', 'allocs' and 'hits' count objects taken from the slabs, which includes the
+	// 'cached' objects sitting in magazines.  'hit_pct' is the share of all allocations
+	// that needed no new slab.  Slack is everything in the slabs that is not an allocated
+	// object: headers, padding, and free and cached objects.  Rounding is the space lost to
+	// generic requests being rounded up to their size class.
+	return snprintf(buffer, size,
+			"%s objsize=%lu active=%lu total=%lu slabs=%u pages_per_slab=%lu allocs=%lu hits=%lu "
+			"magazine_allocs=%lu magazine_frees=%lu cached=%lu exchanges=%lu depot_full=%u depot_empty=%u hit_pct=%lu "
+			"grows=%lu shrinks=%lu slack=%lu rounding=%lu\n",
+			_name, _object_size, _nr_active, (uint64_t)_nr_slabs * _objects_per_slab, _nr_slabs, (uint64_t)_slab_pages,
+			_nr_allocs, _nr_hits, _nr_magazine_allocs, _nr_magazine_frees, _nr_cached, _nr_depot_exchanges,
+			_nr_depot_full, _nr_depot_empty, nr_allocs ? ((_nr_magazine_allocs + _nr_hits) * 100) / nr_allocs : 0,
+			_nr_grows, _nr_shrinks, (_nr_slabs * slab_bytes) - live_bytes, live_bytes - _bytes_requested);
+}
+
+ObjectCache ObjectCache::_magazine_cache("magazine", sizeof(ObjectCache::Magazine), NULL, OBJECT_CACHE_NO_MAGAZINES);
+
+ObjectCache *slab::first_cache()
+{
+	return caches;
+}
+
+static ObjectCache size_classes[SLAB_NR_CLASSES] = {
+	{ "size-16", 16 },
+	{ "size-32", 32 },
+	{ "size-64", 64 },
+	{ "size-128", 128 },
+	{ "size-256", 256 },
+	{ "size-512", 512 },
+	{ "size-1024", 1024 },
+	{ "size-2048", 2048 },
+};
+
+static uint64_t nr_large_allocs, nr_large_frees;
+
+/**
+ * Returns the size class cache for a generic request, or NULL if it is too large.
+ */
+static inline ObjectCache *size_class_of(size_t size)
+{
+	unsigned int shift = SLAB_MIN_CLASS_SHIFT;
+
+	while (((size_t)1 << shift) < size) {
+		if (++shift > SLAB_MAX_CLASS_SHIFT) {
+			return NULL;
+		}
+	}
+
+	return &size_classes[shift - SLAB_MIN_CLASS_SHIFT];
+}
+
+void *slab::alloc(size_t size)
+{
+	ObjectCache *cache = size_class_of(size);
+
+	if (!cache) {
+		nr_large_allocs++;
+		return sys.mm().objalloc().alloc(size);
+	}
+
+	void *object = cache->alloc();
+	if (object) {
+		cache->account_request(size, true);
+	}
+
+	return object;
+}
+
+void slab::free(void *ptr, size_t size)
+{
+	if (!ptr) return;
+
+	ObjectCache *cache = size_class_of(size);
+
+	if (!cache) {
+		nr_large_frees++;
+		sys.mm().objalloc().free(ptr);
+		return;
+	}
+
+	cache->account_request(size, false);
+	cache->free(ptr);
+}
+
+/**
+ * An open slab statistics file.  As with the scheduler statistics, the report is generated
+ * when the file is opened.
+ */
+class SlabInfoFile : public ReportFile
+{
+public:
+	SlabInfoFile() : ReportFile(512 * (nr_caches() + 2))
+	{
+		char line[512];
+
+		_report.appendf("large allocs=%lu frees=%lu\n", nr_large_allocs, nr_large_frees);
+
+		for (ObjectCache *cache = caches; cache; cache = cache->next_cache()) {
+			// Format each line under the lock, so the counters in it are consistent.
+			{
+				UniqueIRQLock l;
+				cache->format_stats(line, sizeof(line));
+			}
+
+			_report.appendf("%s", line);
+		}
+	}
+
+private:
+	static unsigned int nr_caches()
+	{
+		unsigned int count = 0;
+		for (ObjectCache *cache = caches; cache; cache = cache->next_cache()) {
+			count++;
+		}
+
+		return count;
+	}
+};
+
+/**
+ * A device exposing the object cache statistics, which appears in devfs as /dev/slabinfo0.
+ */
+class SlabInfoDevice : public Device
+{
+public:
+	static const DeviceClass SlabInfoDeviceClass;
+
+	const DeviceClass& device_class() const override { return SlabInfoDeviceClass; }
+
+	File *open_as_file() override
+	{
+		return new SlabInfoFile();
+	}
+};
+
+const DeviceClass SlabInfoDevice::SlabInfoDeviceClass(Device::RootDeviceClass, "slabinfo");
+
+static SlabInfoDevice slab_info_device;
+
+void slab::init()
+{
+	static bool registered;
+
+	if (registered) return;
+	registered = true;
+
+	if (!sys.device_manager().register_device(slab_info_device)) {
+		mm_log.message(LogLevel::WARNING, "Unable to register slab statistics device");
+	}
+}
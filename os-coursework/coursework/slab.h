@@ -0,0 +1,193 @@
+/*
+ * Slab Object Allocator Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1346249
+ */
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <infos/define.h>
+#include <infos/assert.h>
+
+namespace slab {
+
+	/**
+	 * The smallest and largest generic size classes, as powers of two.  Generic
+	 * allocations larger than the largest class go to the kernel's object allocator.
+	 */
+	#define SLAB_MIN_CLASS_SHIFT	4
+	#define SLAB_MAX_CLASS_SHIFT	11
+	#define SLAB_NR_CLASSES			(SLAB_MAX_CLASS_SHIFT - SLAB_MIN_CLASS_SHIFT + 1)
+
+	/**
+	 * Object cache flags.
+	 */
+	#define OBJECT_CACHE_NO_MAGAZINES	1	// Always allocate directly from the slabs.
+
+	/**
+	 * A named cache of fixed-size objects.  Objects are carved out of slabs -- naturally
+	 * aligned runs of pages taken from the buddy allocator -- so allocating and freeing
+	 * an object is a free-list push or pop, and the slab header is found by masking the
+	 * object's address.  Under other page allocation algorithms, objects come straight
+	 * from the kernel's object allocator.
+	 *
+	 * If the cache has a constructor, it is run once, when an object's slab is created,
+	 * and never again: freed objects are handed out again as they were left.  The free-list
+	 * link of such a cache is stored after the object, so the object itself is untouched.
+	 *
+	 * In front of the slabs is a magazine layer.  The CPU holds a loaded and a previous
+	 * magazine -- small stacks of free objects -- and allocations and frees are served from
+	 * these without touching the slabs.  When both are exhausted (or both are full), a
+	 * magazine is exchanged with the depot, which holds full and empty magazines for the
+	 * cache.  Only when the depot cannot help do objects move to or from the slabs.
+	 */
+	class ObjectCache {
+	public:
+		typedef void (*Constructor)(void *object);
+
+		/**
+		 * Constructs a new object cache.  Caches are expected to be static objects, and
+		 * are never destroyed.
+		 * @param name The name of the cache, as it appears in /dev/slabinfo0.
+		 * @param object_size The size of each object.
+		 * @param ctor An optional constructor, run once per object.
+		 * @param flags OBJECT_CACHE_* flags.
+		 */
+		ObjectCache(const char *name, size_t object_size, Constructor ctor = NULL, unsigned int flags = 0);
+
+		/**
+		 * Allocates an object.
+		 * @return Returns the object, or NULL if no memory is available.
+		 */
+		void *alloc();
+
+		/**
+		 * Returns an object to the cache.
+		 * @param object The object, which MUST have been allocated from this cache.
+		 */
+		void free(void *object);
+
+		const char *name() const { return _name; }
+		size_t object_size() const { return _object_size; }
+
+		/**
+		 * Writes one line of statistics for the cache.
+		 * @return Returns the number of characters written, which is truncated to 'size', as the
+		 * kernel's snprintf does.
+		 */
+		int format_stats(char *buffer, size_t size) const;
+
+		/**
+		 * Accounts for the difference between a generic request and its size class.
+		 */
+		void account_request(size_t requested, bool alloc);
+
+		ObjectCache *next_cache() const { return _next_cache; }
+
+	private:
+		struct Slab;
+		struct Magazine;
+
+		const char *_name;
+		size_t _object_size;
+		size_t _stride;
+		size_t _link_offset;
+		Constructor _ctor;
+
+		// Each slab takes _slab_pages pages, aligned to a block of 2^_slab_order pages.
+		int _slab_order;
+		unsigned int _slab_pages;
+		unsigned int _objects_per_slab;
+		size_t _first_object_offset;
+
+		// Slabs with at least one free object (including empty slabs), and slabs with none.
+		Slab *_partial;
+		Slab *_full;
+		unsigned int _nr_slabs, _nr_empty_slabs;
+
+		uint64_t _nr_active;
+		uint64_t _nr_allocs, _nr_hits, _nr_frees, _nr_grows, _nr_shrinks;
+		uint64_t _bytes_requested;
+
+		// The magazine layer.  InfOS runs on a single CPU, so there is one loaded and one
+		// previous magazine per cache.
+		bool _use_magazines;
+		Magazine *_loaded, *_previous;
+		Magazine *_depot_full, *_depot_empty;
+		unsigned int _nr_depot_full, _nr_depot_empty;
+
+		uint64_t _nr_cached;
+		uint64_t _nr_magazine_allocs, _nr_magazine_frees, _nr_depot_exchanges;
+
+		// The cache that magazines themselves are allocated from.
+		static ObjectCache _magazine_cache;
+
+		ObjectCache *_next_cache;
+
+		void *&link_of(void *object) const { return *(void **)((uintptr_t)object + _link_offset); }
+		Slab *slab_of(void *object) const;
+
+		Slab *grow();
+		void release(Slab *slab);
+
+		void *slab_alloc();
+		void slab_free(void *object);
+
+		bool magazine_alloc(void *&object);
+		bool magazine_free(void *object);
+
+		static Magazine *pop_magazine(Magazine *&list, unsigned int& count);
+		static void push_magazine(Magazine *&list, unsigned int& count, Magazine *magazine);
+
+		static void unlink(Slab *&list, Slab *slab);
+		static void push(Slab *&list, Slab *slab);
+	};
+
+	/**
+	 * Registers the statistics device, /dev/slabinfo0.  There is no hook for modules to
+	 * register devices during boot, so this is called while the scheduler initialises, from
+	 * sched_stats.  Later calls do nothing.
+	 */
+	extern void init();
+
+	/**
+	 * Returns the first registered object cache.  The rest follow through next_cache().
+	 */
+	extern ObjectCache *first_cache();
+
+	/**
+	 * Allocates a small object from the power-of-two size classes, or from the kernel's
+	 * object allocator if it is too large for any class.
+	 * @param size The size of the object.
+	 * @return Returns the object, or NULL if no memory is available.
+	 */
+	extern void *alloc(size_t size);
+
+	/**
+	 * Frees an object allocated with slab::alloc().
+	 * @param ptr The object.
+	 * @param size The size that was passed to slab::alloc().
+	 */
+	extern void free(void *ptr, size_t size);
+}
+
+/**
+ * Declares, inside a class, that objects of the class are allocated from a named cache.
+ * The cache itself is defined with RegisterObjectCache.
+ */
+#define SlabAllocated \
+	static void *operator new(size_t size); \
+	static void operator delete(void *ptr)
+
+/**
+ * Defines the named cache for a class declared as SlabAllocated, along with its
+ * allocation operators.
+ */
+#define RegisterObjectCache(_class, _name) \
+	static slab::ObjectCache __object_cache_##_class(_name, sizeof(_class)); \
+	void *_class::operator new(size_t size) { assert(size == sizeof(_class)); return __object_cache_##_class.alloc(); } \
+	void _class::operator delete(void *ptr) { __object_cache_##_class.free(ptr); }
+
+#endif /* SLAB_H */
@@ -16,6 +16,9 @@ using namespace infos::kernel;
 using namespace infos::util;
 using namespace tarfs;
 
+RegisterObjectCache(TarFSNode, "tarfs-node");
+RegisterObjectCache(TarFSFile, "tarfs-file");
+
 
 /**
  * TAR files contain header data encoded as octal values in ASCII.  This function
@@ -128,12 +131,11 @@ int TarFSFile::pread(void *buffer, size_t size, off_t off) {
         inclusive_size = file_size - byte_off;
     }
 
-    // Reads the blocks moving them into a temporary space str_read and deallocating this variable from
-    // memory once finished to avoid memory leaks
-    char* str_read = new char[block_size * nr_blocks];
+    // Reads the blocks moving them into a temporary space str_read, which is deallocated once the
+    // data has been copied out of it
+    char* str_read = (char *) slab::alloc(block_size * nr_blocks);
     _owner.block_device().read_blocks(str_read, block_off + _file_start_block, nr_blocks);
     const char *original = str_read + byte_off;
-    delete str_read;
 
     // Copies the data from the offset temporary space original into the buffer
     char *temp_buffer = (char*) buffer;
@@ -141,6 +143,8 @@ int TarFSFile::pread(void *buffer, size_t size, off_t off) {
         *temp_buffer++ = *original++;
     }
 
+    slab::free(str_read, block_size * nr_blocks);
+
     return inclusive_size;
 }
 
@@ -156,7 +160,7 @@ TarFSNode *TarFS::build_tree() {
     TarFSNode *lead_node = root;
 
     // Initialises the file header, file path and file name to begin analysing Tar nodes
-    struct posix_header *file_hdr = (struct posix_header *) new char[block_device().block_size()];
+    struct posix_header *file_hdr = (struct posix_header *) slab::alloc(block_device().block_size());
     infos::util::String file_path;
     infos::util::String file_name;
     unsigned int file_size;
@@ -170,17 +174,17 @@ TarFSNode *TarFS::build_tree() {
 
         // Check if the zero block is present in the file header which shows the archive end
         if (is_zero_block((uint8_t *) file_hdr)) {
-            uint8_t *block_zero = new uint8_t[block_device().block_size()];
+            uint8_t *block_zero = (uint8_t *) slab::alloc(block_device().block_size());
             block_device().read_blocks(block_zero, off_indx + 1, 1);
 
             // Checks if the and offset adjusted block_zero is the block with the archive end and breaks the loop if so.
             // Deallocates the memory for this either way to avoid memory leaks
 
             if (is_zero_block(block_zero)) {
-                delete(block_zero);
+                slab::free(block_zero, block_device().block_size());
                 break;
             }
-            delete(block_zero);
+            slab::free(block_zero, block_device().block_size());
         }
 
         // Splits the path into a list of parts and updates the file_name with the last value of the path
@@ -235,6 +239,8 @@ TarFSNode *TarFS::build_tree() {
 
     }
 
+    slab::free(file_hdr, block_device().block_size());
+
     // You must read the TAR file, and build a tree of TarFSNodes that represents each file present in the archive.
     return root;
 }
@@ -274,7 +280,7 @@ TarFSFile::TarFSFile(TarFS &owner, unsigned int file_header_block)
           _file_start_block(file_header_block),
           _cur_pos(0) {
     // Allocate storage for the header.
-    _hdr = (struct posix_header *) new char[_owner.block_device().block_size()];
+    _hdr = (struct posix_header *) slab::alloc(_owner.block_device().block_size());
 
     // Read the header block into the header structure.
     _owner.block_device().read_blocks(_hdr, _file_start_block, 1);
@@ -285,7 +291,7 @@ TarFSFile::TarFSFile(TarFS &owner, unsigned int file_header_block)
 
 TarFSFile::~TarFSFile() {
     // Delete the header structure that was allocated in the constructor.
-    delete _hdr;
+    slab::free(_hdr, _owner.block_device().block_size());
 }
 
 /**
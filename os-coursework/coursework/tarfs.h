@@ -20,6 +20,8 @@
 #include <infos/util/map.h>
 #include <infos/util/list.h>
 
+#include "slab.h"
+
 namespace tarfs {
 
 	class TarFSNode;
@@ -62,6 +64,8 @@ namespace tarfs {
 		TarFSFile(TarFS& owner, unsigned int file_header_block);
 		virtual ~TarFSFile();
 
+		SlabAllocated;
+
 		void close() override;
 
 		int read(void* buffer, size_t size) override;
@@ -103,6 +107,8 @@ namespace tarfs {
 		TarFSNode(TarFSNode *parent, const infos::util::String& name, TarFS& owner);
 		virtual ~TarFSNode();
 
+		SlabAllocated;
+
 		infos::fs::File* open() override;
 		infos::fs::Directory* opendir() override;
 